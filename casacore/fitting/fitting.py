@@ -1,10 +1,125 @@
-from ._fitting import fitting
+from ._fitting import fitting, _fit_many, _normeq, _preparedfit
 
 import numpy as NUM
 from casacore import six
 from casacore.functionals import *
 
 
+class normeq(_normeq):
+    """Normal equations of a linear least squares fit.
+
+    Condition equations for a functional that is linear in its parameters
+    can be added in chunks with :meth:`accumulate`, so the data never have
+    to be in memory at once. Normal equations accumulated independently
+    (e.g. in different threads or processes) can be combined with
+    :meth:`merge`. A normeq object can be pickled.
+
+    Note that an object must not be used by multiple threads at the same
+    time; use one per thread and merge them.
+
+    Example::
+
+      ne = normeq(poly(2))
+      for x, y in chunks:
+          ne.accumulate(x, y)
+      res = ne.solve()
+      print res['sol'], res['error']
+
+    """
+
+    def __init__(self, fnct):
+        if isinstance(fnct, functional):
+            fnct = fnct.todict()
+        _normeq.__init__(self, fnct)
+        self._fnct = fnct
+
+    def __reduce__(self):
+        return (_restore_normeq, (self.todict(),))
+
+    def accumulate(self, x, y, sd=None, wt=1.0):
+        """Add the condition equations for the given points.
+
+        :param x: the abscissa values (ndim values per point)
+        :param y: the ordinate values
+        :param sd: standard deviation of the equations (one or per point)
+        :param wt: an optional alternate for `sd`
+        """
+        y = NUM.ascontiguousarray(y, dtype=float).ravel()
+        x = NUM.ascontiguousarray(x, dtype=float).ravel()
+        self._accumulate(x, y, _weights(sd, wt).ravel())
+
+    def merge(self, other):
+        """Add the normal equations of another normeq object."""
+        self._merge(other)
+
+    def solve(self, colfac=1.0e-8):
+        """Solve the normal equations accumulated so far.
+
+        A dict is returned with the solution (`sol`), `error`, `covar`,
+        `rank`, `deficiency`, `chi2`, `sd` and `mu`.
+        The normal equations are kept, so more data can be added.
+        """
+        return self._solve(colfac)
+
+    def todict(self):
+        """Get the state as a dict (with the functional)."""
+        return self._todict()
+
+
+class preparedfit(_preparedfit):
+    """A fitter prepared for repeated fits of the same functional.
+
+    The functional is converted and the fitter (with its work arrays) is
+    created once, so calling :meth:`fit` many times (e.g. for each time
+    slot) has no setup overhead. It is created by :meth:`fitserver.prepare`.
+
+    """
+
+    def __init__(self, fnct, linear=False, mxit=50, colfac=1.0e-8):
+        if not isinstance(fnct, functional):
+            raise TypeError("No or illegal functional")
+        _preparedfit.__init__(self, fnct.todict(), linear, mxit, colfac)
+        self._initial = NUM.array(fnct.get_parameters(), dtype=float)
+
+    def fit(self, x, y, sd=None, wt=1.0, initial=None):
+        """Fit the functional to the given points.
+
+        :param x: the abscissa values (ndim values per point)
+        :param y: the ordinate values
+        :param sd: standard deviation of the equations (one or per point)
+        :param wt: an optional alternate for `sd`
+        :param initial: the initial parameter values (default the
+                        parameters of the functional when prepared)
+        :returns: a dict with `sol`, `error`, `chi2`, `rank` and `converged`
+
+        """
+        x = NUM.ascontiguousarray(x, dtype=float).ravel()
+        y = NUM.ascontiguousarray(y, dtype=float).ravel()
+        wt = _weights(sd, wt).ravel()
+        if initial is None:
+            initial = self._initial
+        initial = NUM.ascontiguousarray(initial, dtype=float).ravel()
+        return self._fit(x, y, wt, initial)
+
+
+def _weights(sd, wt):
+    # Get the weights as a contiguous float array from the standard
+    # deviations (if given) or the weights. An sd of 0 or -1 gives weight 0.
+    if sd is not None:
+        sd = NUM.asarray(sd, dtype=float)
+        wt = sd.copy()
+        wt[sd == 0] = 1
+        wt = 1 / (wt * wt)
+        wt[NUM.logical_or(sd == -1, sd == 0)] = 0
+    return NUM.ascontiguousarray(wt, dtype=float)
+
+
+def _restore_normeq(state):
+    ne = normeq(state['fnct'])
+    ne._fromdict(state)
+    return ne
+
+
 class fitserver(object):
     """Create a `fitserver instance.
 
@@ -194,6 +309,7 @@ class fitserver(object):
         self._checkid(fid)
         self._fitids[fid]["solved"] = False
         self._fitids[fid]["haserr"] = False
+        self._fitids[fid].pop("normeq", None)
         if not self._fitids[fid]["looped"]:
             return self._fitproxy.reset(fid)
         else:
@@ -374,6 +490,126 @@ class fitserver(object):
         """
         self._fit(fitfunc="linear", fnct=fnct, x=x, y=y, sd=sd, wt=wt, fid=fid)
 
+    def fit_many(self, fnct, x, y, sd=None, wt=1.0, initial=None, mxit=50,
+                 linear=False, colfac=1.0e-8, nthreads=0):
+        """Solve many independent problems with the same functional.
+
+        Each row of `y` is fitted separately with `fnct` at the abscissa
+        values `x` (shared by all problems). The problems are solved in C++
+        by `nthreads` threads (0 means all cores), each reusing its own
+        fitter, so no Python call is made per problem. The sub-fitters of
+        the fitserver are not used or changed.
+
+        :param fnct: the (real) functional to fit
+        :param x: the abscissa values (ndim values per point)
+        :param y: the ordinate values as an array [nproblems, npoints]
+        :param sd: standard deviations, per point or per problem and point
+        :param wt: an optional alternate for `sd`
+        :param initial: initial parameter values, as [npar] for all problems
+                        or [nproblems, npar]; default the functional's
+                        parameters (not needed for linear fits)
+        :param mxit: the maximum number of iterations of a non-linear fit
+        :param linear: do a linear (SVD) fit instead of Levenberg-Marquardt
+        :param colfac: collinearity factor
+        :param nthreads: the number of threads to use
+        :returns: a dict with arrays `sol` and `error` [nproblems, npar],
+                  `chi2`, `rank` and `converged` [nproblems]
+
+        Example::
+
+            fit = fitserver()
+            g = gaussian1d([1, 0, 1])
+            res = fit.fit_many(g, x, cube.reshape(-1, len(x)))
+            heights = res['sol'][:, 0]
+
+        """
+        if not isinstance(fnct, functional):
+            raise TypeError("No or illegal functional")
+        x = NUM.ascontiguousarray(x, dtype=float).ravel()
+        y = NUM.ascontiguousarray(y, dtype=float)
+        if y.ndim == 1:
+            y = y.reshape(1, -1)
+        wt = _weights(sd, wt)
+        if initial is None:
+            initial = fnct.get_parameters()
+        initial = NUM.ascontiguousarray(initial, dtype=float)
+        return _fit_many(fnct.todict(), x, y, wt.ravel(), initial.ravel(),
+                         mxit, linear, colfac, nthreads)
+
+    def prepare(self, fnct, linear=False, mxit=50, colfac=1.0e-8):
+        """Prepare a fitter for repeated fits of the same functional.
+
+        A :class:`preparedfit` object is returned, whose `fit` method can be
+        called for each data set. It avoids the setup done by
+        :meth:`functional` and :meth:`linear` for each call.
+
+        :param fnct: the (real) functional to fit
+        :param linear: do linear (SVD) fits instead of Levenberg-Marquardt
+        :param mxit: the maximum number of iterations of a non-linear fit
+        :param colfac: collinearity factor
+
+        Example::
+
+            pf = fit.prepare(gaussian1d([1, 0, 1]))
+            for y in spectra:
+                print pf.fit(x, y)['sol']
+
+        """
+        return preparedfit(fnct, linear, mxit, colfac)
+
+    def accumulate(self, fnct, x, y, sd=None, wt=1.0, fid=0):
+        """Add condition equations to the normal equations of a linear fit.
+
+        This makes it possible to do a linear fit on more data than fits
+        in memory: call accumulate for each chunk of data and :meth:`solve`
+        at the end. The first call creates the normal equations for `fnct`;
+        :meth:`reset` clears them. The arguments are as in :meth:`linear`.
+
+        """
+        self._checkid(fid)
+        ne = self._fitids[fid].get("normeq")
+        if ne is None:
+            if not isinstance(fnct, functional):
+                raise TypeError("No or illegal functional")
+            ne = normeq(fnct)
+            self._fitids[fid]["normeq"] = ne
+        elif fnct is not None and fnct.npar() != ne.npar():
+            raise ValueError("Functional has a different number of "
+                             "parameters than the accumulated equations")
+        ne.accumulate(x, y, sd, wt)
+
+    def normeq(self, fid=0):
+        """Get the normal equations accumulated for a sub-fitter
+        (e.g. to :meth:`merge` it into another one)."""
+        self._checkid(fid)
+        if "normeq" not in self._fitids[fid]:
+            raise RuntimeError("No equations accumulated")
+        return self._fitids[fid]["normeq"]
+
+    def merge(self, other, fid=0):
+        """Merge normal equations (a :class:`normeq` object, e.g. made
+        in a parallel worker) into those of the sub-fitter."""
+        self._checkid(fid)
+        if "normeq" not in self._fitids[fid]:
+            self._fitids[fid]["normeq"] = normeq(other.todict()["fnct"])
+        self._fitids[fid]["normeq"].merge(other)
+
+    def solve(self, fid=0):
+        """Solve the normal equations made by :meth:`accumulate`.
+
+        Thereafter the results can be obtained with :meth:`solution`,
+        :meth:`error`, etc. More equations can still be added.
+
+        """
+        result = dict(self.normeq(fid).solve(
+            self.getstate(fid).get("colfac", 1.0e-8)))
+        result.pop("ok", None)
+        self._fitids[fid].update(result)
+        self._fitids[fid]["solved"] = True
+        self._fitids[fid]["haserr"] = True
+        self._fitids[fid]["looped"] = False
+        return result["sol"]
+
     def _getval(self, valname, fid):
         self._checkid(fid)
         if not self._fitids[fid]["solved"]:
@@ -1,7 +1,10 @@
-from ._functionals import _functional
+from ._functionals import _functional, _fasteval, _exprkernel
 
 import numpy
 
+# The 1-dim real functionals that can be evaluated by the fast C++ kernels.
+_fastnames = ('gaussian1d', 'poly', 'evenpoly', 'oddpoly', 'chebyshev')
+
 
 class functional(_functional):
     def __init__(self, name=None, order=-1, params=None, mode=None, dtype=0):
@@ -25,6 +28,8 @@ class functional(_functional):
         if isinstance(mode, dict):
             d['mode'] = mode
         _functional.__init__(self, d, self._dtype)
+        self._name = name
+        self._fast = self._fastcomponents(name, mode)
         if hasattr(params, "__len__"):
             params = self._flatten(params)
             if len(params) == 0:
@@ -38,6 +43,24 @@ class functional(_functional):
     def __repr__(self):
         return str(self.todict())
 
+    def _fastcomponents(self, name, mode):
+        # Get the (name, npar, interval) of the components if the functional
+        # can be evaluated by the fast kernels, otherwise None.
+        if self._dtype != 0:
+            return None
+        if name == 'compound':
+            return []
+        if name not in _fastnames:
+            return None
+        interval = [0., 0., 0.]
+        if name == 'chebyshev':
+            mode = mode or {}
+            if mode.get('intervalMode', 'constant') != 'constant':
+                return None
+            interval = [float(v) for v in mode.get('interval', [-1., 1.])]
+            interval.append(float(mode.get('default', 0.)))
+        return [(name, self.npar(), interval)]
+
     def _flatten(self, x):
         if (isinstance(x, numpy.ndarray) and x.ndim > 1
             and x.ndim == self.ndim()):
@@ -108,12 +131,39 @@ class functional(_functional):
             a(0.0)
 
         """
+        if self._fast is not None and numpy.isrealobj(x):
+            return self._fastf(x)
         x = self._flatten(x)
+        kernel = self._exprkernel(x)
+        if kernel is not None:
+            return kernel._f(numpy.asarray(x, dtype=float).ravel(),
+                             self.get_parameters(), 0)
         if self._dtype == 0:
             return numpy.array(_functional._f(self, x))
         else:
             return numpy.array(_functional._fc(self, x))
 
+    def _exprkernel(self, x):
+        # Get the array kernel of a compiled functional if it can be used
+        # for x. The kernel only accepts expressions of which it reproduces
+        # the CompiledFunction results, so they need not be checked here.
+        kernel = getattr(self, '_kernel', None)
+        if kernel is None or not numpy.isrealobj(x):
+            return None
+        if numpy.size(x) == 0:
+            return None
+        return kernel
+
+    def _fastf(self, x, nthreads=0):
+        # Evaluate a (sum of) built-in 1-dim functional(s) in C++ for all
+        # values at once; large arrays are split over nthreads threads
+        # (0 means all cores).
+        x = numpy.asarray(x, dtype=float).ravel()
+        return _fasteval([c[0] for c in self._fast],
+                         [c[1] for c in self._fast],
+                         [v for c in self._fast for v in c[2]],
+                         self.get_parameters(), x, nthreads)
+
     def __call__(self, x, derivatives=False):
         if derivatives:
             return numpy.array(self.fdf(x))
@@ -136,6 +186,13 @@ class functional(_functional):
 
         """
         x = self._flatten(x)
+        kernel = self._exprkernel(x)
+        if kernel is not None:
+            retval = kernel._fdf(numpy.asarray(x, dtype=float).ravel(),
+                                 self.get_parameters(), 0)
+            if self.npar() == 0:
+                return retval.ravel()
+            return retval
         n = 1
         if hasattr(x, "__len__"):
             n = len(x)
@@ -158,6 +215,11 @@ class functional(_functional):
             _functional._add(self, other)
         else:
             _functional._addc(self, other)
+        if (self._name == 'compound' and self._fast is not None
+                and other._fast is not None):
+            self._fast = self._fast + other._fast
+        else:
+            self._fast = None
 
     def set_mask(self, i, msk):
         _functional._setmask(self, i, msk)
@@ -341,3 +403,14 @@ class compiled(functional):
     def __init__(self, code="", params=None, dtype=0):
         functional.__init__(self, name="compiled", order=code,
                             params=params, dtype=dtype)
+        # Real expressions using the supported syntax are evaluated for
+        # whole arrays by a compiled kernel (with dual numbers for fdf).
+        self._kernel = None
+        if self._dtype == 0:
+            try:
+                kernel = _exprkernel(code)
+                if (kernel.npar() == self.npar() and
+                        max(1, kernel.ndim()) == self.ndim()):
+                    self._kernel = kernel
+            except Exception:
+                pass
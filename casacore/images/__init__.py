@@ -49,6 +49,7 @@ The following functionality exists:
 - get statistics
 - form a subimage
 - form an image expression which is treated as an ordinary image
+- build a lazy expression from image objects using Python operators
 - regrid the image
 - write the image to a FITS file
 
@@ -56,3 +57,4 @@ The following functionality exists:
 
 # Make image interface available.
 from .image import image
+from .imageexpr import imageexpr, iif, lelfunction
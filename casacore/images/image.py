@@ -36,6 +36,7 @@ except ImportError:
     import numpy.core.ma as nma
 
 from casacore.images.coordinates import coordinatesystem
+from casacore.images.imageexpr import imageexpr
 from casacore import six
 
 
@@ -115,6 +116,13 @@ class image(Image):
       im = image(shape=(256,256))       # create temp image
       im = image('a', shape=(256,256))  # create image a
 
+    Python operators on image objects do not calculate anything, but
+    build a lazy :class:`imageexpr` that is evaluated as a single LEL
+    expression when used::
+
+      pbcor = (im / pb).mask(pb > 0.2)
+      pbcor.saveas('a.pbcor')           # evaluated tile by tile
+
     """
 
     def __init__(self, imagename, axis=0, maskname="", images=(), values=None,
@@ -190,6 +198,78 @@ class image(Image):
         """Get nr of pixels in the image."""
         return self._size()
 
+    def expr(self):
+        """Get the image as a lazy :class:`imageexpr`."""
+        return imageexpr(self)
+
+    def mask(self, condition):
+        """Form a lazy expression masking the image with a condition.
+
+        Pixels where the condition (an :class:`imageexpr` or boolean image)
+        is False are masked off. See :class:`imageexpr` for more information.
+
+        """
+        return imageexpr(self).mask(condition)
+
+    # Arithmetic and ordering operators build a lazy image expression.
+    # == and != are not overloaded; they keep comparing image objects.
+    def __add__(self, other):
+        return imageexpr(self) + other
+
+    def __radd__(self, other):
+        return other + imageexpr(self)
+
+    def __sub__(self, other):
+        return imageexpr(self) - other
+
+    def __rsub__(self, other):
+        return other - imageexpr(self)
+
+    def __mul__(self, other):
+        return imageexpr(self) * other
+
+    def __rmul__(self, other):
+        return other * imageexpr(self)
+
+    def __truediv__(self, other):
+        return imageexpr(self) / other
+
+    def __rtruediv__(self, other):
+        return other / imageexpr(self)
+
+    __div__ = __truediv__
+    __rdiv__ = __rtruediv__
+
+    def __pow__(self, other):
+        return imageexpr(self) ** other
+
+    def __neg__(self):
+        return -imageexpr(self)
+
+    def __abs__(self):
+        return abs(imageexpr(self))
+
+    def __lt__(self, other):
+        return imageexpr(self) < other
+
+    def __le__(self, other):
+        return imageexpr(self) <= other
+
+    def __gt__(self, other):
+        return imageexpr(self) > other
+
+    def __ge__(self, other):
+        return imageexpr(self) >= other
+
+    def __eq__(self, other):
+        return imageexpr(self) == other
+
+    def __ne__(self, other):
+        return imageexpr(self) != other
+
+    # == is overloaded, so keep hashing by identity.
+    __hash__ = object.__hash__
+
     def ispersistent(self):
         """Test if the image is persistent, i.e. stored on disk."""
         return self._ispersistent()
@@ -289,7 +369,7 @@ class image(Image):
            of an attribute in a row in a group."""
         return self._attrput(groupname, attrname, rownr, value, unit, meas)
 
-    def getdata(self, blc=(), trc=(), inc=()):
+    def getdata(self, blc=(), trc=(), inc=(), level=0):
         """Get image data.
 
         Using the arguments blc (bottom left corner), trc (top right corner),
@@ -298,13 +378,22 @@ class image(Image):
         The data is returned as a numpy array. Its dimensionality is the same
         as the dimensionality of the image, even if an axis has length 1.
 
+        If `level` is given, the data are read from that level of the
+        pyramid made by :func:`build_pyramid`. The slice is still given in
+        full resolution pixels, but on the pyramid axes blc and inc must be
+        a multiple of the level's downsampling factor. The result is the same
+        as reading the full resolution image, but far fewer tiles are read.
+
         """
+        if level:
+            (im, blc, trc, inc) = self._pyramidslice(level, blc, trc, inc)
+            return im._getdata(blc, trc, inc)
         return self._getdata(self._adjustBlc(blc),
                              self._adjustTrc(trc),
                              self._adjustInc(inc))
 
     # Negate the mask; in numpy True means invalid.
-    def getmask(self, blc=(), trc=(), inc=()):
+    def getmask(self, blc=(), trc=(), inc=(), level=0):
         """Get image mask.
 
         Using the arguments blc (bottom left corner), trc (top right corner),
@@ -321,21 +410,180 @@ class image(Image):
         If the image has no mask, an array will be returned with all values
         set to False.
 
+        The mask can be read from a pyramid level like :func:`getdata`.
+
         """
+        if level:
+            (im, blc, trc, inc) = self._pyramidslice(level, blc, trc, inc)
+            return numpy.logical_not(im._getmask(blc, trc, inc))
         return numpy.logical_not(self._getmask(self._adjustBlc(blc),
                                                self._adjustTrc(trc),
                                                self._adjustInc(inc)))
 
     # Get data and mask
-    def get(self, blc=(), trc=(), inc=()):
+    def get(self, blc=(), trc=(), inc=(), level=0):
         """Get image data and mask.
 
         Get the image data and mask (see ::func:`getdata` and :func:`getmask`)
         as a numpy masked array.
 
         """
-        return nma.masked_array(self.getdata(blc, trc, inc),
-                                self.getmask(blc, trc, inc))
+        return nma.masked_array(self.getdata(blc, trc, inc, level),
+                                self.getmask(blc, trc, inc, level))
+
+    def nicecursorshape(self):
+        """Get the chunk shape that fits the tiling of the image.
+
+        For a virtual image (e.g. a concatenation or subimage) it is derived
+        from the tiling of the underlying images.
+
+        """
+        return self._nicecursorshape()
+
+    def iterchunks(self, cursorshape=(), prefetch=True):
+        """Iterate through the image data in tile-aligned chunks.
+
+        A generator is returned yielding tuples of the blc of a chunk and
+        its data as a numpy array. By default the chunk shape is given by
+        :func:`nicecursorshape`, so each read maps onto whole tiles of the
+        (underlying) images and their tile caches are used optimally.
+        It is the preferred way to process a virtual image (such as a
+        concatenation of many channel images) without making a copy.
+
+        If `prefetch` is True, the next chunk is read in a background
+        thread while the caller processes the current one. The image
+        should not be used in other ways while iterating.
+
+        """
+        import threading
+        shape = self.shape()
+        if len(cursorshape) == 0:
+            cursorshape = self.nicecursorshape()
+        cursorshape = self._adjust(cursorshape, list(shape))
+        nchunk = [(shape[i] + cursorshape[i] - 1) // cursorshape[i]
+                  for i in range(len(shape))]
+        inc = [1 for x in shape]
+
+        # Get the blc and trc of the n-th chunk (last axis varies fastest).
+        def chunk(n):
+            blc = [0 for x in shape]
+            for i in range(len(shape) - 1, -1, -1):
+                blc[i] = (n % nchunk[i]) * cursorshape[i]
+                n //= nchunk[i]
+            trc = [min(blc[i] + cursorshape[i], shape[i]) - 1
+                   for i in range(len(shape))]
+            return (blc, trc)
+
+        def read(n, result):
+            (blc, trc) = chunk(n)
+            try:
+                result.append((blc, self._getdatanogil(blc, trc, inc)))
+            except Exception as e:
+                result.append(e)
+
+        total = 1
+        for n in nchunk:
+            total *= n
+        nextres = []
+        read(0, nextres)
+        for n in range(total):
+            result = nextres
+            nextres = []
+            thread = None
+            if prefetch and n + 1 < total:
+                thread = threading.Thread(target=read, args=(n + 1, nextres))
+                thread.start()
+            elif n + 1 < total:
+                read(n + 1, nextres)
+            try:
+                if isinstance(result[0], Exception):
+                    raise result[0]
+                yield result[0]
+            finally:
+                if thread is not None:
+                    thread.join()
+
+    def build_pyramid(self, levels=3, factor=2, axes=(-2, -1)):
+        """Build a multi-resolution pyramid for fast strided reads.
+
+        Level k of the pyramid is a copy of the image decimated by
+        `factor**k` along the given axes (by default the last two axes,
+        normally Dec and RA). Each level is made from the previous one, so
+        the full resolution image is read only once.
+
+        The levels are stored as images inside the image directory (named
+        PYRAMID1, PYRAMID2, ...) and are described in the image attribute
+        group PYRAMID. They can be used in :func:`getdata` and
+        :func:`getmask` using their `level` argument.
+        Note that a pyramid is a snapshot; it has to be built again after
+        the image data has changed.
+
+        It can only be done for a persistent image in casacore format.
+
+        """
+        if self.imagetype() != 'PagedImage':
+            raise ValueError('A pyramid can only be built for a PagedImage')
+        ndim = self.ndim()
+        axes = [ax % ndim for ax in axes]
+        if 'PYRAMID' not in self.attrgroupnames():
+            self.attrcreategroup('PYRAMID')
+        inc = [1 for i in range(ndim)]
+        facs = [1 for i in range(ndim)]
+        for ax in axes:
+            inc[ax] = factor
+        prev = self
+        for k in range(1, levels + 1):
+            name = 'PYRAMID' + str(k)
+            prev.subimage(inc=inc, dropdegenerate=False).saveas(
+                self.name() + '/' + name)
+            prev = image(self.name() + '/' + name)
+            for ax in axes:
+                facs[ax] *= factor
+            self.attrput('PYRAMID', 'LEVEL', k - 1, k)
+            self.attrput('PYRAMID', 'NAME', k - 1, name)
+            self.attrput('PYRAMID', 'FACTOR', k - 1, list(facs))
+        # Remove the levels of an earlier pyramid with more levels.
+        # Attribute rows cannot be removed, so they are cleared (an empty
+        # NAME ends the list of levels).
+        from casacore.tables import tabledelete, tableexists
+        for k in range(levels + 1, self.attrnrows('PYRAMID') + 1):
+            name = self.name() + '/PYRAMID' + str(k)
+            if tableexists(name):
+                tabledelete(name, ack=False)
+            self.attrput('PYRAMID', 'LEVEL', k - 1, 0)
+            self.attrput('PYRAMID', 'NAME', k - 1, '')
+
+    def pyramidlevels(self):
+        """Get the number of pyramid levels built by :func:`build_pyramid`."""
+        if 'PYRAMID' not in self.attrgroupnames():
+            return 0
+        nlevel = 0
+        for name in self.attrgetcol('PYRAMID', 'NAME'):
+            if not name:
+                break
+            nlevel += 1
+        return nlevel
+
+    # Get the image of a pyramid level and convert a full resolution
+    # slice to that level.
+    def _pyramidslice(self, level, blc, trc, inc):
+        if level < 1 or level > self.pyramidlevels():
+            raise ValueError('Image has no pyramid level ' + str(level))
+        name = self.attrget('PYRAMID', 'NAME', level - 1)
+        facs = self.attrget('PYRAMID', 'FACTOR', level - 1)
+        blc = self._adjustBlc(blc)
+        trc = self._adjustTrc(trc)
+        inc = self._adjustInc(inc)
+        for i in range(len(facs)):
+            f = facs[i]
+            if blc[i] % f != 0 or inc[i] % f != 0:
+                raise ValueError('blc and inc on axis ' + str(i) +
+                                 ' must be a multiple of ' + str(f) +
+                                 ' to use pyramid level ' + str(level))
+            blc[i] //= f
+            trc[i] //= f
+            inc[i] //= f
+        return (image(self.name() + '/' + name), blc, trc, inc)
 
     def putdata(self, value, blc=(), trc=(), inc=()):
         """Put image data.
@@ -435,7 +683,8 @@ class image(Image):
 
         A subimage is a so-called virtual image. It is not stored, but only
         references the original image. It can be made persistent using the
-        :func:`saveas` method.
+        :func:`saveas` method, but usually it is better to process it
+        directly using :func:`iterchunks`.
 
         """
         return image(self._subimage(self._adjustBlc(blc),
@@ -490,7 +739,8 @@ class image(Image):
                 }
 
     def tofits(self, filename, overwrite=True, velocity=True,
-               optical=True, bitpix=-32, minpix=1, maxpix=-1):
+               optical=True, bitpix=-32, minpix=1, maxpix=-1, memory=None,
+               nthreads=0, progress=None):
         """Write the image to a file in FITS format.
 
         `filename`
@@ -513,13 +763,36 @@ class image(Image):
           Oherwise the supplied values will be used and pixels outside that
           range will be clipped to the minimum and maximum pixel values.
           Note that this truncation does not occur for `bitpix=-32`.
+        `memory`
+          | If given (or if `progress` is given), the image is exported in
+            chunks using about `memory` MB (default 64). Each chunk is a
+            contiguous block of FITS rows. The chunks are read one by one,
+            converted (and scaled for `bitpix=16`) in parallel and written
+            by a separate thread with large sequential writes.
+          | The Python GIL is released while converting and writing, so
+            several images can be exported in parallel using Python threads.
+            A double image is converted to float on the fly.
+            The FITS file does not contain the image history and extra
+            tables (e.g. of multiple beams).
+        `nthreads`
+          The number of threads converting a chunk in the chunked export.
+          0 means the number of cores.
+        `progress`
+          A function called in the chunked export after each chunk as
+          ``progress(done, total)`` giving the number of pixels exported
+          and the total number of pixels.
 
         """
+        if memory is not None or progress is not None:
+            return self._tofitschunked(filename, overwrite, velocity, optical,
+                                       bitpix, minpix, maxpix,
+                                       64 if memory is None else memory,
+                                       nthreads, progress)
         return self._tofits(filename, overwrite, velocity, optical,
                             bitpix, minpix, maxpix)
 
     def saveas(self, filename, overwrite=True, hdf5=False,
-               copymask=True, newmaskname="", newtileshape=()):
+               copymask=True, newmaskname="", newtileshape=(), compress=""):
         """Write the image to disk.
 
         Note that the created disk file is a snapshot, so it is not updated
@@ -540,11 +813,26 @@ class image(Image):
         `tileshape`
           Advanced users can give a new tile shape. See the :mod:`tables`
           module for more information about Tiled Storage Managers.
+        `compress`
+          | If given, the pixels are stored compressed in casacore format.
+            Tiles can still be accessed randomly and the image can be read
+            like any other image.
+          | Only the codec 'scaled' is supported. It stores the pixels as
+            16-bit integers scaled to the data range (using the CompressFloat
+            or CompressComplex engine), thus it is lossy with an error of at
+            most (max-min)/131068. It can be used for float and complex images.
 
         """
-        self._saveas(filename, overwrite, hdf5,
-                     copymask, newmaskname,
-                     newtileshape)
+        if compress:
+            if hdf5:
+                raise ValueError('A compressed image cannot be stored ' +
+                                 'in HDF5 format')
+            self._saveascompressed(filename, overwrite, copymask,
+                                   newmaskname, newtileshape, compress)
+        else:
+            self._saveas(filename, overwrite, hdf5,
+                         copymask, newmaskname,
+                         newtileshape)
 
     def statistics(self, axes=(), minmaxvalues=(), exclude=False, robust=True):
         """Calculate statistics for the image.
@@ -0,0 +1,301 @@
+# imageexpr.py: Lazy LEL expressions built from Python image objects
+# Copyright (C) 2008
+# Associated Universities, Inc. Washington DC, USA.
+#
+# This library is free software; you can redistribute it and/or modify it
+# under the terms of the GNU Library General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or (at your
+# option) any later version.
+#
+# This library is distributed in the hope that it will be useful, but WITHOUT
+# ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+# FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+# License for more details.
+#
+# You should have received a copy of the GNU Library General Public License
+# along with this library; if not, write to the Free Software Foundation,
+# Inc., 675 Massachusetts Ave, Cambridge, MA 02139, USA.
+#
+# Correspondence concerning AIPS++ should be addressed as follows:
+#        Internet email: aips2-request@nrao.edu.
+#        Postal address: AIPS++ Project Office
+#                        National Radio Astronomy Observatory
+#                        520 Edgemont Road
+#                        Charlottesville, VA 22903-2475 USA
+#
+# $Id$
+
+from ._images import Image
+
+import math
+import numbers
+
+__all__ = ['imageexpr', 'iif', 'lelfunction']
+
+
+class imageexpr(object):
+    """A lazy image expression.
+
+    An imageexpr is a tree of operations on image objects and constants.
+    Nothing is read or calculated while the tree is built. Only when the
+    expression is used (e.g. by :func:`getdata` or :func:`saveas`) the tree
+    is compiled into a single `LEL expression
+    <../../casacore/doc/notes/223.html>`_ in which each image is referenced
+    as `$n`. Casacore evaluates such an expression chunk by chunk
+    (usually tile by tile), so no temporary arrays are made for the
+    intermediate results.
+
+    An expression is usually created by applying Python operators to
+    image objects, for example::
+
+      ex = a*2 + b.mask(c > 0)
+      ex.saveas('pbcor.img')         # evaluate straight into a new image
+
+    The operators ``+ - * / % **`` are arithmetic, ``< <= > >= == !=``
+    compare, and ``& | ~`` are the logical and, or, and not.
+    They behave the same on image objects and expressions, so ``a == 1``
+    is an expression as well. Use ``is`` to test if two image objects are
+    the same. An expression has no truth value, so it cannot be used in
+    e.g. an ``if`` statement.
+
+    """
+
+    def __init__(self, value):
+        if isinstance(value, imageexpr):
+            self.__dict__.update(value.__dict__)
+        elif isinstance(value, Image):
+            self._op = 'image'
+            self._args = (value,)
+        else:
+            self._op = 'const'
+            self._args = (_lelconstant(value),)
+
+    @classmethod
+    def _make(cls, op, *args):
+        ex = cls.__new__(cls)
+        ex._op = op
+        ex._args = tuple(args)
+        return ex
+
+    def lel(self):
+        """Compile the expression.
+
+        A tuple is returned containing the LEL command string and the list
+        of image objects referenced by `$n` in that string.
+
+        """
+        images = []
+        return (self._compile(images), images)
+
+    def __str__(self):
+        return self.lel()[0]
+
+    def _compile(self, images):
+        if self._op == 'image':
+            img = self._args[0]
+            for i in range(len(images)):
+                if images[i] is img:
+                    return '$' + str(i + 1)
+            images.append(img)
+            return '$' + str(len(images))
+        if self._op == 'const':
+            if self._args[0].startswith('-'):
+                return '(' + self._args[0] + ')'
+            return self._args[0]
+        args = [arg._compile(images) for arg in self._args]
+        if self._op == 'func':
+            return self._fname + '(' + ','.join(args) + ')'
+        if self._op == 'mask':
+            return '(' + args[0] + ')[' + args[1] + ']'
+        if len(args) == 1:
+            return '(' + self._op + args[0] + ')'
+        return '(' + args[0] + self._op + args[1] + ')'
+
+    def _binary(self, op, other, reverse=False):
+        other = imageexpr(other)
+        if reverse:
+            return imageexpr._make(op, other, self)
+        return imageexpr._make(op, self, other)
+
+    def __add__(self, other):
+        return self._binary('+', other)
+
+    def __radd__(self, other):
+        return self._binary('+', other, True)
+
+    def __sub__(self, other):
+        return self._binary('-', other)
+
+    def __rsub__(self, other):
+        return self._binary('-', other, True)
+
+    def __mul__(self, other):
+        return self._binary('*', other)
+
+    def __rmul__(self, other):
+        return self._binary('*', other, True)
+
+    def __truediv__(self, other):
+        return self._binary('/', other)
+
+    def __rtruediv__(self, other):
+        return self._binary('/', other, True)
+
+    __div__ = __truediv__
+    __rdiv__ = __rtruediv__
+
+    def __mod__(self, other):
+        return self._binary('%', other)
+
+    def __rmod__(self, other):
+        return self._binary('%', other, True)
+
+    def __pow__(self, other):
+        return self._binary('^', other)
+
+    def __rpow__(self, other):
+        return self._binary('^', other, True)
+
+    def __lt__(self, other):
+        return self._binary('<', other)
+
+    def __le__(self, other):
+        return self._binary('<=', other)
+
+    def __gt__(self, other):
+        return self._binary('>', other)
+
+    def __ge__(self, other):
+        return self._binary('>=', other)
+
+    def __eq__(self, other):
+        return self._binary('==', other)
+
+    def __ne__(self, other):
+        return self._binary('!=', other)
+
+    def __and__(self, other):
+        return self._binary('&&', other)
+
+    def __rand__(self, other):
+        return self._binary('&&', other, True)
+
+    def __or__(self, other):
+        return self._binary('||', other)
+
+    def __ror__(self, other):
+        return self._binary('||', other, True)
+
+    def __neg__(self):
+        return imageexpr._make('-', self)
+
+    def __pos__(self):
+        return self
+
+    def __invert__(self):
+        return imageexpr._make('!', self)
+
+    def __abs__(self):
+        return lelfunction('abs', self)
+
+    def __bool__(self):
+        raise TypeError('the truth value of an image expression is undefined;'
+                        ' evaluate it using getdata()')
+
+    __nonzero__ = __bool__
+
+    # == is overloaded, so keep hashing by identity.
+    __hash__ = object.__hash__
+
+    def mask(self, condition):
+        """Mask the expression with a boolean condition (LEL `expr[cond]`).
+
+        Pixels where the condition is False are masked off (i.e. invalid).
+
+        """
+        return imageexpr._make('mask', self, imageexpr(condition))
+
+    def replace(self, value=0):
+        """Replace masked off pixels by the given value."""
+        return lelfunction('replace', self, value)
+
+    def image(self):
+        """Return the expression as a (virtual) image object.
+
+        The image is not evaluated; reading it evaluates the expression
+        for the requested part only.
+
+        """
+        from casacore.images.image import image
+        (expr, images) = self.lel()
+        return image(expr, images=images)
+
+    def getdata(self, blc=(), trc=(), inc=()):
+        """Evaluate the expression for the given slice and return its data."""
+        return self.image().getdata(blc, trc, inc)
+
+    def getmask(self, blc=(), trc=(), inc=()):
+        """Evaluate the mask of the expression for the given slice."""
+        return self.image().getmask(blc, trc, inc)
+
+    def get(self, blc=(), trc=(), inc=()):
+        """Evaluate the expression and its mask as a numpy masked array."""
+        return self.image().get(blc, trc, inc)
+
+    def saveas(self, filename, overwrite=True, hdf5=False,
+               copymask=True, newmaskname="", newtileshape=()):
+        """Evaluate the expression into a new persistent image.
+
+        The expression is evaluated tile by tile straight into the output
+        image, so no full-size intermediate arrays are created.
+        The arguments are the same as for :func:`image.saveas`.
+        The new image is opened and returned.
+
+        """
+        from casacore.images.image import image
+        self.image().saveas(filename, overwrite, hdf5,
+                            copymask, newmaskname, newtileshape)
+        return image(filename)
+
+
+def lelfunction(name, *args):
+    """Apply a LEL function (e.g. `sqrt`, `max`, `iif`) to the arguments.
+
+    The arguments can be image objects, expressions or constants.
+    For example::
+
+      lelfunction('sqrt', a*a + b*b)
+
+    """
+    ex = imageexpr._make('func', *[imageexpr(arg) for arg in args])
+    ex._fname = name
+    return ex
+
+
+def iif(condition, a, b):
+    """Return `a` where the condition is True, otherwise `b`."""
+    return lelfunction('iif', condition, a, b)
+
+
+def _lelconstant(value):
+    if isinstance(value, bool):
+        return 'T' if value else 'F'
+    if isinstance(value, numbers.Integral):
+        return str(int(value))
+    if isinstance(value, numbers.Real):
+        return _lelfloat(value)
+    if isinstance(value, numbers.Complex):
+        return ('complex(' + _lelfloat(value.real) + ',' +
+                _lelfloat(value.imag) + ')')
+    raise TypeError('imageexpr operand must be an image, expression ' +
+                    'or numeric constant, not ' + type(value).__name__)
+
+
+def _lelfloat(value):
+    # LEL cannot parse Python's 'nan' and 'inf'; use its functions instead.
+    value = float(value)
+    if math.isnan(value):
+        return 'nan()'
+    if math.isinf(value):
+        return 'inf()' if value > 0 else '-inf()'
+    return repr(value)
@@ -27,8 +27,11 @@
 __all__ = ['is_measure', 'measures']
 
 from ._measures import measures as _measures
+from ._measures import _convert_many, _uvw_grid, _direction_angles
+from ._measures import _get_interval, _set_interval
 
 import casacore.quanta as dq
+import numpy
 import os
 
 if 'MEASURESDATA' in os.environ.keys():
@@ -118,6 +121,159 @@ class measures(_measures):
                     v[key] = v[key].to_dict()
         return _measures.measure(self, v, rf, off)
 
+    def measure_many(self, mtype, values, ref, frame_epochs=None,
+                     inref='', epochref='UTC', nthreads=1):
+        """Convert an array of measure values in a single call.
+
+        Unlike :meth:`measure` the values are plain numbers in numpy arrays,
+        and a single conversion engine is used for all of them. The frame
+        set with :meth:`do_frame` is used.
+
+        :param mtype: the measure type: 'direction', 'position', or 'epoch'
+        :param values: numpy array with the values. Its last axis contains
+                       (lon,lat) in rad for a direction and (x,y,z) in m for
+                       a position. An epoch is given as MJD in seconds.
+        :param ref: the reference code to convert to
+        :param frame_epochs: optional array with a frame epoch (MJD in
+                             seconds) per value. It replaces the epoch in the
+                             frame. Consecutive values with the same epoch
+                             share the frame calculations, so it is best to
+                             order the values in time.
+        :param inref: the reference code of the values. Default is J2000 for
+                      a direction, ITRF for a position, and UTC for an epoch.
+        :param epochref: the reference code of the frame epochs
+        :param nthreads: the number of threads to use (0 means the number
+                         of cores). The values are split in contiguous
+                         parts, each converted by a thread with its own copy
+                         of the frame. The GIL is released during the
+                         conversion.
+        :returns: numpy array with the converted values (same shape as values)
+
+        Example::
+
+            >>> dm.do_frame(dm.observatory('WSRT'))
+            >>> azel = dm.measure_many('direction', radec, 'AZEL',
+            ...                        frame_epochs=times)
+
+        """
+        defref = {'direction': 'J2000', 'position': 'ITRF', 'epoch': 'UTC'}
+        mtype = mtype.lower()
+        if mtype not in defref:
+            raise TypeError('measure_many cannot convert ' + mtype)
+        if not inref:
+            inref = defref[mtype]
+        values = numpy.ascontiguousarray(values, dtype=numpy.float64)
+        if frame_epochs is None:
+            epochs = numpy.zeros(0)
+        else:
+            shape = values.shape if mtype == 'epoch' else values.shape[:-1]
+            epochs = numpy.ascontiguousarray(
+                numpy.broadcast_to(frame_epochs, shape), dtype=numpy.float64)
+        return _convert_many(mtype, values, inref, ref, epochs, epochref,
+                             self._frame(frame_epochs is None), nthreads)
+
+    def uvw_grid(self, antenna_positions, epochs, phase_center,
+                 antenna1=None, antenna2=None, epochref='UTC', nthreads=1):
+        """Calculate the J2000 uvw coordinates of many antennas and epochs.
+
+        It is the array version of :meth:`touvw`. For each epoch the
+        rotation from ITRF to uvw is calculated once and applied to all
+        antennas in a C++ loop.
+
+        :param antenna_positions: numpy array [nant,3] with the ITRF x,y,z
+                                  positions of the antennas in m.
+        :param epochs: numpy array with the epochs (MJD in seconds)
+        :param phase_center: a direction measure
+        :param antenna1, antenna2: optional arrays of antenna indices
+                                   defining baselines. If given, the uvw of
+                                   each baseline (antenna2 - antenna1) is
+                                   returned instead of the antenna uvw.
+        :param epochref: the reference code of the epochs
+        :param nthreads: the number of threads to use (0 means the number
+                         of cores). The epochs are divided over the threads.
+        :returns: numpy array [ntime,nant,3] (or [ntime,nbaseline,3]) with
+                  the uvw coordinates in m.
+
+        The position in the frame (see :meth:`do_frame`) is used as the
+        array position. If not set, the first antenna position is used.
+
+        Example::
+
+            >>> uvw = dm.uvw_grid(antpos, times, dm.direction('J2000',
+            ...                   '1h30m', '52d'), ant1, ant2)
+
+        """
+        if not is_measure(phase_center) or \
+                phase_center['type'] != 'direction':
+            raise TypeError('Phase center must be a direction measure')
+        positions = numpy.ascontiguousarray(antenna_positions,
+                                            dtype=numpy.float64)
+        epochs = numpy.ascontiguousarray(numpy.atleast_1d(epochs),
+                                         dtype=numpy.float64)
+        frame = self._frame(False)
+        if 'position' not in frame:
+            (x, y, z) = [dq.quantity(float(v), 'm') for v in positions[0]]
+            frame['position'] = self.position('ITRF', x, y, z)
+        uvw = _uvw_grid(positions, epochs, self.measure(phase_center,
+                                                         phase_center['refer']),
+                        epochref, frame, nthreads)
+        if antenna1 is None:
+            return uvw
+        return uvw[:, antenna2, :] - uvw[:, antenna1, :]
+
+    def set_frame_cache(self, interval,
+                        which=('precession', 'nutation', 'aberration')):
+        """Set the interval of the frame calculation cache.
+
+        Casacore does not calculate the precession, nutation, and aberration
+        for every epoch. Instead, it calculates them (and their time
+        derivatives) exactly for an epoch and extrapolates linearly for
+        epochs within the given interval from it. By default the interval is
+        0.1 day for precession and 0.04 day for nutation and aberration.
+        A larger interval makes conversions for dense epoch grids (e.g. per
+        integration) much cheaper; an interval of 0 disables the cache.
+
+        The extrapolation error is dominated by the 13.66 day nutation term
+        (0.23 arcsec), giving about ``0.024 * dt**2`` arcsec for an interval
+        `dt` (in days), and the annual aberration (20.5 arcsec), giving about
+        ``0.003 * dt**2`` arcsec. So the direction error is bounded by about
+        ``0.027 * dt**2`` arcsec, thus about 0.0003 arcsec for 0.1 day.
+        Precession is smooth enough to be exact for any practical interval.
+
+        There is no default interval, because the setting changes the
+        accuracy of all conversions; it has to be chosen explicitly.
+
+        Note that the setting is global; it applies to all measures objects
+        and conversions done afterwards.
+
+        :param interval: the interval as a time quantity or string
+        :param which: the calculations to set the interval for
+        :returns: a `dict` with the old intervals in days
+
+        """
+        days = dq.quantity(interval).get_value('d')
+        old = {}
+        for name in which:
+            old[name] = _set_interval(name, days)
+        return old
+
+    def get_frame_cache(self):
+        """Get the intervals (in days) used for the frame calculation cache.
+
+        See :meth:`set_frame_cache` for more information.
+
+        """
+        return dict([(name, _get_interval(name)) for name in
+                     ('precession', 'nutation', 'aberration')])
+
+    # Get the frame measures as a dict to be passed to the C++ functions.
+    def _frame(self, withepoch=True):
+        frame = {}
+        for key in ['epoch', 'position', 'direction', 'radialvelocity']:
+            if key in self._framestack and (withepoch or key != 'epoch'):
+                frame[key] = self._framestack[key]
+        return frame
+
     def direction(self, rf='', v0='0..', v1='90..', off=None):
         """Defines a direction measure. It has to specify a reference code,
         direction quantity values (see introduction for the action on a
@@ -803,6 +959,35 @@ class measures(_measures):
         return dict(rise=dq.quantity(c["m0"]).norm(0) - a,
                     set=dq.quantity(c["m0"]).norm(0) + a)
 
+    def rise_many(self, directions, ref='J2000', ev='5deg'):
+        """Array version of :meth:`rise`.
+
+        It gives the rise and set sidereal times (as angles in rad) of many
+        sources using the position and epoch in the frame. All directions
+        are converted with a single conversion engine.
+
+        :param directions: numpy array [n,2] with (lon,lat) in rad
+        :param ref: the reference code of the directions
+        :param ev: the elevation limit as a quantity or string
+        :returns: `dict` with arrays 'rise' and 'set' (NaN if the source does
+                  not rise or set) and boolean arrays 'below' and 'above'
+                  telling if the source is always below or above the limit.
+        """
+        ps = self._getwhere()
+        self._fillnow()
+        hd = self.measure_many('direction', directions, 'HADEC', inref=ref)
+        app = self.measure_many('direction', directions, 'APP', inref=ref)
+        lat = dq.quantity(ps['m1']).get_value('rad')
+        evr = dq.quantity(ev).get_value('rad')
+        ct = (numpy.sin(evr) - numpy.sin(hd[..., 1]) * numpy.sin(lat)) \
+            / (numpy.cos(hd[..., 1]) * numpy.cos(lat))
+        below = ct >= 1
+        above = ct <= -1
+        a = numpy.arccos(numpy.clip(ct, -1, 1))
+        a[below | above] = numpy.nan
+        ra = numpy.mod(app[..., 0], 2 * numpy.pi)
+        return {'rise': ra - a, 'set': ra + a, 'below': below, 'above': above}
+
     def riseset(self, crd, ev="5deg"):
         """This will give the rise/set times of a source. It needs the
         position in the frame, and a time. If the latter is not set, the
@@ -960,6 +1145,41 @@ class measures(_measures):
        """
         return _measures.separation(self, m0, m1)
 
+    def _directionangles(self, dir0, dir1, ref0, ref1, outer, posangle):
+        dir0 = numpy.ascontiguousarray(dir0, dtype=numpy.float64)
+        dir1 = numpy.ascontiguousarray(dir1, dtype=numpy.float64)
+        if ref1.upper() != ref0.upper():
+            dir1 = self.measure_many('direction', dir1, ref0, inref=ref1)
+        return _direction_angles(dir0.reshape(-1, 2), dir1.reshape(-1, 2),
+                                 outer, posangle)
+
+    def separation_many(self, dir0, dir1, ref0='J2000', ref1='J2000',
+                        outer=False):
+        """Array version of :meth:`separation`.
+
+        :param dir0: numpy array [n0,2] with (lon,lat) in rad
+        :param dir1: numpy array [n1,2] with (lon,lat) in rad
+        :param ref0, ref1: the reference codes of the directions. If they
+                           differ, dir1 is converted to ref0 first.
+        :param outer: if True, the separations between all directions in
+                      dir0 and all directions in dir1 are returned as an
+                      [n0,n1] array (e.g. a catalog against a calibrator list).
+                      Otherwise the separations of the pairs are returned
+                      (n0 and n1 must be equal or 1).
+        :returns: numpy array with the separations in rad
+        """
+        return self._directionangles(dir0, dir1, ref0, ref1, outer, False)
+
+    def posangle_many(self, dir0, dir1, ref0='J2000', ref1='J2000',
+                      outer=False):
+        """Array version of :meth:`posangle`.
+
+        The arguments are the same as for :meth:`separation_many`.
+
+        :returns: numpy array with the position angles in rad
+        """
+        return self._directionangles(dir0, dir1, ref0, ref1, outer, True)
+
 ##     def show(v, refcode=True):
 ##         z = ""
 ##         if is_measure(v):
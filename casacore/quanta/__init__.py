@@ -1,6 +1,8 @@
 from ._quanta import *
 
 from .quantity import quantity, is_quantity
+from .quantity import format_times, format_angles, parse_times, parse_angles
+from .quantarray import quantarray, converter
 
 constants = constants()
 units = units()
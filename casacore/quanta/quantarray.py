@@ -0,0 +1,294 @@
+# quantarray.py: numpy arrays with a unit
+# Copyright (C) 2017
+# Associated Universities, Inc. Washington DC, USA.
+#
+# This library is free software; you can redistribute it and/or modify it
+# under the terms of the GNU Library General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or (at your
+# option) any later version.
+#
+# This library is distributed in the hope that it will be useful, but WITHOUT
+# ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+# FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+# License for more details.
+#
+# You should have received a copy of the GNU Library General Public License
+# along with this library; if not, write to the Free Software Foundation,
+# Inc., 675 Massachusetts Ave, Cambridge, MA 02139, USA.
+#
+# Correspondence concerning AIPS++ should be addressed as follows:
+#        Internet email: aips2-request@nrao.edu.
+#        Postal address: AIPS++ Project Office
+#                        National Radio Astronomy Observatory
+#                        520 Edgemont Road
+#                        Charlottesville, VA 22903-2475 USA
+#
+# $Id$
+
+import numpy
+
+from ._quanta import unit_factor
+
+
+class quantarray(object):
+    """A numpy array with a unit.
+
+    Unlike :class:`QuantVec`, which copies its values into a casacore
+    Vector<Double>, a quantarray keeps its values in a numpy array of any
+    numeric type (e.g. float32 or complex). Arithmetic is done by numpy on
+    the array as a whole; casacore is only used to derive the unit of the
+    result and the factor to convert between units, which is done once per
+    operation instead of per element.
+
+    `value`
+      The values (anything accepted by numpy.asarray). The array is not
+      copied unless `copy=True` or a conversion to `dtype` is needed.
+    `unit`
+      The unit as a casacore unit string (e.g. 'km/s').
+
+    Values without a unit used in an addition, subtraction or comparison
+    are taken to be in the unit of the quantarray.
+
+    For example::
+
+      v = quantarray(numpy.zeros(1000000, 'float32'), 'km/s')
+      v.convert('m/s')                     # in place
+      d = v * quantarray(times, 's')       # unit is (m/s).(s)
+      d.get_value('km')
+
+    """
+
+    # Make numpy defer to our reflected operators.
+    __array_priority__ = 100
+
+    def __init__(self, value, unit='', dtype=None, copy=False):
+        if isinstance(value, quantarray):
+            if not unit:
+                unit = value.unit
+            else:
+                value = value.get_value(unit)
+            value = value.value if isinstance(value, quantarray) else value
+        if copy:
+            self.value = numpy.array(value, dtype=dtype)
+        else:
+            self.value = numpy.asarray(value, dtype=dtype)
+        self.unit = unit
+
+    def __repr__(self):
+        return 'quantarray(' + repr(self.value) + ', ' + repr(self.unit) + ')'
+
+    def __str__(self):
+        return str(self.value) + ' ' + self.unit
+
+    def __len__(self):
+        return len(self.value)
+
+    def __getitem__(self, index):
+        return quantarray(self.value[index], self.unit)
+
+    def __setitem__(self, index, value):
+        self.value[index] = self._valuein(value)
+
+    @property
+    def shape(self):
+        return self.value.shape
+
+    @property
+    def dtype(self):
+        return self.value.dtype
+
+    def get_unit(self):
+        """Get the unit."""
+        return self.unit
+
+    def conforms(self, other):
+        """Test if the unit conforms to the unit of a quantity or a string."""
+        try:
+            unit_factor(self.unit, _unit(other))
+            return True
+        except Exception:
+            return False
+
+    def get_value(self, unit=None):
+        """Get the values (in the given unit) as a numpy array.
+
+        If no unit is given or it is the same, no copy is made.
+
+        """
+        if unit is None or unit == self.unit:
+            return self.value
+        return self.value * unit_factor(self.unit, unit)
+
+    def get(self, unit):
+        """Get a new quantarray with the values converted to the unit."""
+        return quantarray(self.get_value(unit), unit)
+
+    def convert(self, unit):
+        """Convert the values in place to the given unit.
+
+        An integer array is replaced by a floating point array.
+
+        """
+        fac = unit_factor(self.unit, _unit(unit))
+        if fac != 1:
+            if numpy.issubdtype(self.value.dtype, numpy.inexact):
+                self.value *= fac
+            else:
+                self.value = self.value * fac
+        self.unit = _unit(unit)
+
+    def astype(self, dtype):
+        """Get a copy with the values converted to the given data type."""
+        return quantarray(self.value.astype(dtype), self.unit)
+
+    # Get the values of the other operand in the unit of self.
+    def _valuein(self, other):
+        if isinstance(other, quantarray):
+            return other.get_value(self.unit)
+        if hasattr(other, 'get_value') and hasattr(other, 'get_unit'):
+            return numpy.asarray(other.get_value()) * \
+                unit_factor(other.get_unit(), self.unit)
+        return other
+
+    # Get value and unit of the other operand of a multiplication.
+    @staticmethod
+    def _valueunit(other):
+        if isinstance(other, quantarray):
+            return (other.value, other.unit)
+        if hasattr(other, 'get_value') and hasattr(other, 'get_unit'):
+            return (numpy.asarray(other.get_value()), other.get_unit())
+        return (other, '')
+
+    def __add__(self, other):
+        return quantarray(self.value + self._valuein(other), self.unit)
+
+    __radd__ = __add__
+
+    def __iadd__(self, other):
+        self.value += self._valuein(other)
+        return self
+
+    def __sub__(self, other):
+        return quantarray(self.value - self._valuein(other), self.unit)
+
+    def __rsub__(self, other):
+        return quantarray(self._valuein(other) - self.value, self.unit)
+
+    def __isub__(self, other):
+        self.value -= self._valuein(other)
+        return self
+
+    def __mul__(self, other):
+        (val, unit) = self._valueunit(other)
+        return quantarray(self.value * val, _mulunit(self.unit, unit, '.'))
+
+    __rmul__ = __mul__
+
+    def __imul__(self, other):
+        (val, unit) = self._valueunit(other)
+        self.value *= val
+        self.unit = _mulunit(self.unit, unit, '.')
+        return self
+
+    def __truediv__(self, other):
+        (val, unit) = self._valueunit(other)
+        return quantarray(self.value / val, _mulunit(self.unit, unit, '/'))
+
+    def __rtruediv__(self, other):
+        (val, unit) = self._valueunit(other)
+        return quantarray(val / self.value, _mulunit(unit, self.unit, '/'))
+
+    def __itruediv__(self, other):
+        (val, unit) = self._valueunit(other)
+        self.value /= val
+        self.unit = _mulunit(self.unit, unit, '/')
+        return self
+
+    __div__ = __truediv__
+    __rdiv__ = __rtruediv__
+    __idiv__ = __itruediv__
+
+    def __neg__(self):
+        return quantarray(-self.value, self.unit)
+
+    def __pos__(self):
+        return self
+
+    def __abs__(self):
+        return quantarray(numpy.abs(self.value), self.unit)
+
+    def __eq__(self, other):
+        return self.value == self._valuein(other)
+
+    def __ne__(self, other):
+        return self.value != self._valuein(other)
+
+    def __lt__(self, other):
+        return self.value < self._valuein(other)
+
+    def __le__(self, other):
+        return self.value <= self._valuein(other)
+
+    def __gt__(self, other):
+        return self.value > self._valuein(other)
+
+    def __ge__(self, other):
+        return self.value >= self._valuein(other)
+
+    __hash__ = None
+
+
+class converter(object):
+    """Convert values from one unit to another.
+
+    The units are parsed and checked for conformance once, when the
+    converter is created. Thereafter applying it to a scalar, a sequence,
+    a numpy array or a :class:`quantarray` is a single multiplication.
+    For example::
+
+      kms2ms = converter('km/s', 'm/s')
+      kms2ms(3.5)                        # 3500.0
+      kms2ms(numpy.arange(10.))          # numpy array in m/s
+
+    """
+
+    def __init__(self, fromunit, tounit):
+        self.fromunit = _unit(fromunit)
+        self.tounit = _unit(tounit)
+        self.factor = unit_factor(self.fromunit, self.tounit)
+
+    def __repr__(self):
+        return ('converter(' + repr(self.fromunit) + ', ' +
+                repr(self.tounit) + ')')
+
+    def __call__(self, value):
+        """Apply the conversion.
+
+        A quantarray is converted from its own unit (which must conform),
+        yielding a quantarray in the output unit. Other values are taken
+        to be in the input unit; a numpy array is returned for sequences.
+
+        """
+        if isinstance(value, quantarray):
+            return quantarray(value.get_value(self.tounit), self.tounit)
+        if isinstance(value, (list, tuple)):
+            value = numpy.asarray(value)
+        return value * self.factor
+
+    def inverse(self):
+        """Get the converter doing the inverse conversion."""
+        return converter(self.tounit, self.fromunit)
+
+
+def _unit(other):
+    if isinstance(other, str):
+        return other
+    return other.get_unit()
+
+
+def _mulunit(unit1, unit2, op):
+    if not unit2:
+        return unit1 if op == '.' or unit1 else ''
+    if not unit1:
+        return unit2 if op == '.' else '(' + unit2 + ')-1'
+    return '(' + unit1 + ')' + op + '(' + unit2 + ')'
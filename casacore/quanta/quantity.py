@@ -1,6 +1,10 @@
 from ._quanta import QuantVec
 from ._quanta import Quantity
 from ._quanta import from_string, from_dict, from_dict_v
+from ._quanta import _format_times, _format_angles
+from ._quanta import _parse_times, _parse_angles
+
+import numpy
 
 
 def is_quantity(q):
@@ -68,3 +72,38 @@ def quantity(*args):
             return QuantVec(*args)
         else:
             return Quantity(*args)
+
+
+def format_times(values, unit='s', fmt='', precision=0):
+    """Format an array of times as strings.
+
+    The values (in the given unit, e.g. MJD seconds) are formatted in C++
+    without creating a quantity per value. The format and precision are
+    as in :func:`Quantity.formatted` (e.g. 'DMY', 'YMD_ONLY').
+    A numpy string array with the shape of `values` is returned.
+
+    """
+    return _format_times(numpy.asarray(values, dtype=float), unit,
+                         fmt, precision)
+
+
+def format_angles(values, unit='rad', fmt='', precision=0):
+    """Format an array of angles as strings (e.g. format 'TIME' or 'ANGLE').
+
+    See :func:`format_times` for the arguments.
+
+    """
+    return _format_angles(numpy.asarray(values, dtype=float), unit,
+                          fmt, precision)
+
+
+def parse_times(strings, unit='s'):
+    """Parse an array of time strings (e.g. '2014/08/14/14:03:03') into
+    a numpy array of values in the given unit."""
+    return _parse_times(numpy.asarray(strings, dtype=str), unit)
+
+
+def parse_angles(strings, unit='rad'):
+    """Parse an array of angle strings (e.g. '12h10m5s' or '-30.12.2') into
+    a numpy array of values in the given unit."""
+    return _parse_angles(numpy.asarray(strings, dtype=str), unit)
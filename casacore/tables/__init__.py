@@ -66,5 +66,5 @@ from .table import taql
 from .tablecolumn import tablecolumn
 from .tableindex import tableindex
 from .tableiter import tableiter
-from .tablerow import tablerow
+from .tablerow import tablerow, lazyrow
 from .tableutil import *
@@ -41,6 +41,7 @@ Several utility functions exist. Important ones are:
 
 # Make interface to class TableProxy available.
 from ._tables import (Table,
+                      _copy_pipelined,
                       _default_ms,
                       _default_ms_subtable,
                       _required_ms_desc)
@@ -612,7 +613,8 @@ class table(Table):
         self._rename(newtablename)
 
     def copy(self, newtablename, deep=False, valuecopy=False, dminfo={},
-             endian='aipsrc', memorytable=False, copynorows=False):
+             endian='aipsrc', memorytable=False, copynorows=False,
+             readahead=0):
         """Copy the table and return a table object for the copy.
 
         It copies all data in the columns and keywords.
@@ -640,6 +642,17 @@ class table(Table):
           do not copy to disk, but to a table kept in memory.
         `copynorows=True`
           only copy the column layout and keywords, but no data.
+        `readahead`
+          if greater than 0, a value copy is made (as with `valuecopy=True`)
+          where one thread reads the data from this table while another
+          writes them into the new table. The columns are copied in blocks
+          of rows (of about 64 MB), of which up to `readahead` are read
+          ahead (and at most 256 MB in total). The `dminfo` argument can be
+          used to change the storage managers or tile shapes on the way.
+          Note that a casacore table cannot be accessed by multiple threads
+          at the same time, so the only concurrency is between reading and
+          writing; a larger `readahead` only helps to smooth out differences
+          in read and write speed.
 
         For example::
 
@@ -649,8 +662,12 @@ class table(Table):
           t2 = t.copy ('new.tab', True, True)    # reorganize storage
 
         """
-        t = self._copy(newtablename, memorytable, deep, valuecopy,
-                       endian, dminfo, copynorows)
+        if readahead > 0 and not copynorows:
+            t = _copy_pipelined(self, newtablename, memorytable, endian,
+                                dminfo, readahead)
+        else:
+            t = self._copy(newtablename, memorytable, deep, valuecopy,
+                           endian, dminfo, copynorows)
         # copy returns a Table object, so turn that into table.
         return table(t, _oper=3)
 
@@ -982,7 +999,8 @@ class table(Table):
         return self._getcellslicevh(columnname, rownr,
                                     blc, trc, inc, nparray)
 
-    def getcol(self, columnname, startrow=0, nrow=-1, rowincr=1):
+    def getcol(self, columnname, startrow=0, nrow=-1, rowincr=1,
+               packed=False):
         """Get the contents of a column or part of it.
 
         It is returned as a numpy array.
@@ -993,7 +1011,16 @@ class table(Table):
         The column can be sliced by giving a start row (default 0), number of
         rows (default all), and row stride (default 1).
 
+        If `packed=True`, a boolean column (such as FLAG) is returned with
+        8 values packed in each byte along the last axis, which is the
+        same as ``numpy.packbits(getcol(...), axis=-1)`` but uses 8 times
+        less memory. It can be unpacked with
+        ``numpy.unpackbits(result, axis=-1, count=n)``.
+        Note that casacore's storage managers already store booleans as bits.
+
         """
+        if packed:
+            return self._getcolpacked(columnname, startrow, nrow, rowincr)
         #        try:     # trial code to read using a vector of rownrs
         #            nr = len(startrow)
         #            if nrow < 0:
@@ -1023,14 +1050,32 @@ class table(Table):
             raise ValueError("Argument 'nparray' has to be a contiguous numpy array")
         return self._getcolvh(columnname, startrow, nrow, rowincr, nparray)
 
-    def getvarcol(self, columnname, startrow=0, nrow=-1, rowincr=1):
+    def getvarcol(self, columnname, startrow=0, nrow=-1, rowincr=1,
+                  ragged=False):
         """Get the contents of a column or part of it.
 
         It is similar to :func:`getcol`, but the result is returned as a dict of
         numpy arrays.
         It can deal with a column containing variable shaped arrays.
 
+        If `ragged=True`, the result is a dict containing three arrays
+        instead of one array per row:
+
+        - `values` holds the values of all cells as a flat array.
+        - `shapes` holds the shape of each cell (a row per cell) in numpy
+          axis order. If cells have a different dimensionality, the unused
+          leading axes are -1. All axes of an undefined cell are -1.
+        - `offsets` holds the offset of each cell in `values` (and the total
+          number of values as its last element).
+
+        So cell `i` is
+        ``values[offsets[i]:offsets[i+1]].reshape(shapes[i][shapes[i]>=0])``.
+        This avoids making a Python object per row, which is much faster
+        for large columns. The result can be given to :func:`putvarcol`.
+
         """
+        if ragged:
+            return self._getvarcolragged(columnname, startrow, nrow, rowincr)
         return self._getvarcol(columnname, startrow, nrow, rowincr)
 
     def getcolslice(self, columnname, blc, trc, inc=[],
@@ -1127,12 +1172,22 @@ class table(Table):
 
         It is similar to putcol, but the shapes of the arrays in the column
         can vary. The value has to be a dict of numpy arrays.
+        It can also be a ragged array as returned by
+        :func:`getvarcol` with `ragged=True` (a dict with the keys
+        `values`, `shapes` and `offsets`). Cells with a shape of only -1
+        are not written.
 
         The column can be sliced by giving a start row (default 0), number of
         rows (default all), and row stride (default 1).
 
         """
-        self._putvarcol(columnname, startrow, nrow, rowincr, value)
+        if isinstance(value, dict) and \
+                sorted(value.keys()) == ['offsets', 'shapes', 'values']:
+            self._putvarcolragged(columnname, startrow, nrow, rowincr,
+                                  value['values'], value['shapes'],
+                                  value['offsets'])
+        else:
+            self._putvarcol(columnname, startrow, nrow, rowincr, value)
 
     def putcolslice(self, columnname, value, blc, trc, inc=[],
                     startrow=0, nrow=-1, rowincr=1):
@@ -131,15 +131,17 @@ class tablecolumn:
         (see :func:`table.getcellslice`)"""
         return self._table.getcellslice(self._column, rownr, blc, trc, inc)
 
-    def getcol(self, startrow=0, nrow=-1, rowincr=1):
+    def getcol(self, startrow=0, nrow=-1, rowincr=1, packed=False):
         """Get the contents of the column or part of it.
         (see :func:`table.getcol`)"""
-        return self._table.getcol(self._column, startrow, nrow, rowincr)
+        return self._table.getcol(self._column, startrow, nrow, rowincr,
+                                  packed)
 
-    def getvarcol(self, startrow=0, nrow=-1, rowincr=1):
+    def getvarcol(self, startrow=0, nrow=-1, rowincr=1, ragged=False):
         """Get the contents of the column or part of it.
         (see :func:`table.getvarcol`)"""
-        return self._table.getvarcol(self._column, startrow, nrow, rowincr)
+        return self._table.getvarcol(self._column, startrow, nrow, rowincr,
+                                     ragged)
 
     def getcolslice(self, blc, trc, inc=[], startrow=0, nrow=-1, rowincr=1):
         """Get a slice from a table column holding arrays.
@@ -28,7 +28,7 @@
 from casacore.six import PY2
 import numpy
 import re
-from ..quanta import quantity
+from ..quanta import quantity, format_times
 
 # A keywordset in a table can hold tables, but it is not possible to
 # pass them around because a ValueHolder cannot deal with it.
@@ -193,9 +193,14 @@ def _format_cell(val, colkeywords):
             # (quanta does not support higher dimensional arrays)
             valtype='epoch'
             if isinstance(val, numpy.ndarray):
-                numpy.set_printoptions(formatter={'all':lambda x: _format_date(x,colkeywords['QuantumUnits'][0])})
-                out+=numpy.array2string(val,separator=', ')
-                numpy.set_printoptions(formatter=None)
+                # Format all dates at once
+                unit=colkeywords['QuantumUnits'][0]
+                strs=format_times(val, unit, 'DMY')
+                if unit=='d':
+                    whole=(val==numpy.floor(val))
+                    if whole.any():
+                        strs=numpy.where(whole, format_times(val, unit, 'YMD_ONLY'), strs)
+                out+=numpy.array2string(strs,separator=', ',formatter={'all':str})
             else:
                 out+=_format_date(val,colkeywords['QuantumUnits'][0])
         elif colkeywords.get('MEASINFO',{}).get('type')=='direction' and singleUnit and val.shape==(1,2):
@@ -26,9 +26,54 @@
 # $Id: tablerow.py,v 1.6 2007/08/28 07:22:18 gvandiep Exp $
 
 # Make interface to class TableRowProxy available.
-from ._tables import TableRow
+from ._tables import (TableRow, RowConverter)
 
 from .tablehelper import _check_key_slice
+from casacore import six
+
+try:
+    from collections.abc import Mapping
+except ImportError:
+    from collections import Mapping
+
+
+class lazyrow(Mapping):
+    """A read-only mapping holding a row, converting a field on access.
+
+    It is returned by :func:`tablerow.get` when `lazy=True`.
+    A field is converted to a Python object only when it is used, which
+    is cheaper than making a dict if only a few fields of a row are needed.
+    Use :func:`todict` to convert all fields at once.
+
+    """
+
+    def __init__(self, record):
+        self._record = record
+
+    def __getitem__(self, key):
+        if key not in self:
+            raise KeyError(key)
+        return self._record._get(key)
+
+    def __contains__(self, key):
+        return isinstance(key, six.string_types) and key in self._record
+
+    def __iter__(self):
+        return iter(self._record.keys())
+
+    def __len__(self):
+        return len(self._record)
+
+    def __repr__(self):
+        return 'lazyrow(' + repr(self.keys()) + ')'
+
+    def keys(self):
+        """Get the names of the fields."""
+        return list(self._record.keys())
+
+    def todict(self):
+        """Convert all fields to a dict."""
+        return self._record._todict()
 
 
 # A normal tablerow object keeps a reference to a table object to be able
@@ -40,14 +85,25 @@ from .tablehelper import _check_key_slice
 class _tablerow(TableRow):
     def __init__(self, table, columnnames, exclude=False):
         TableRow.__init__(self, table, columnnames, exclude)
+        # The converter keeps the field names and types between rows.
+        self._converter = RowConverter()
 
     def iswritable(self):
         """Tell if all columns in the row object are writable."""
         return self._iswritable()
 
-    def get(self, rownr):
-        """Get the contents of the given row."""
-        return self._get(rownr)
+    def get(self, rownr, lazy=False):
+        """Get the contents of the given row.
+
+        The row is returned as a dict. The conversion plan (field names and
+        types) is kept between calls, so getting many rows is fast.
+        If `lazy=True`, a :class:`lazyrow` mapping is returned which only
+        converts a field when it is accessed.
+
+        """
+        if lazy:
+            return lazyrow(self._converter._getlazy(self, rownr))
+        return self._converter._get(self, rownr)
 
     def put(self, rownr, value, matchingfields=True):
         """Put the values into the given row.
@@ -137,6 +193,23 @@ class tablerow(_tablerow):
         _tablerow.__init__(self, table, columnnames, exclude)
         self._table = table
 
+    def get_range(self, startrow=0, nrow=-1):
+        """Get a range of rows as a numpy structured array.
+
+        Each column of the row object becomes a field of the array.
+        A column holding arrays becomes a subarray field, so its arrays
+        must have the same shape in all rows of the range.
+        Strings are stored as fixed-width unicode fields.
+        Row `i` of the result contains the same values as `get(startrow+i)`.
+
+        The columns are read as a whole, which is much faster than getting
+        the rows one by one. `nrow=-1` means until the end of the table.
+        An empty range (e.g. `startrow` equal to the number of rows) gives
+        an empty array with the same fields.
+
+        """
+        return self._getrange(startrow, nrow)
+
     def __enter__(self):
         """Function to enter a with block."""
         return self
@@ -482,6 +482,82 @@ def maketabdesc(descs=[]):
         rec[colname] = desc['desc']
     return rec
 
+# The virtual column engines compressing float and complex arrays, and the
+# data type of the integer column they store the data in.
+_compress_engines = {'float': ('CompressFloat', 'short'),
+                     'complex': ('CompressComplex', 'int')}
+
+
+def compresscolumns(tabdesc, columnnames):
+    """Make array columns in a table description use compressed storage.
+
+    Each given float or complex array column is turned into a virtual
+    column using a CompressFloat or CompressComplex engine. The engine
+    stores each value as a 16-bit integer (a complex value as two of them)
+    in the array column `<name>_COMPRESSED`, which is added to the table
+    description and stored with the TiledShapeStMan (if the dimensionality
+    is known). The scale and offset of each row are derived automatically
+    from the row's data and stored in the float columns `<name>_SCALE` and
+    `<name>_OFFSET`. It halves (float) or quarters (complex) the storage
+    needed, at the cost of a loss of precision. The column is read and
+    written as usual (e.g. with :func:`table.getcol` and
+    :func:`table.getcolslice`).
+
+    Casacore has no lossless compressing storage manager. Note however
+    that casacore's storage managers already store boolean columns (such
+    as FLAG) as bits.
+
+    The table description is changed in place and also returned.
+    The data manager info has to be made with :func:`makedminfo`, which
+    fills in the specification of the engines. For example::
+
+      td = maketabdesc([makearrcoldesc('DATA', 0j, shape=[16, 4],
+                                       valuetype='complex'),
+                        makearrcoldesc('WEIGHT_SPECTRUM', 0., shape=[16, 4],
+                                       valuetype='float')])
+      compresscolumns(td, ['DATA', 'WEIGHT_SPECTRUM'])
+      t = table('my.tab', td, dminfo=makedminfo(td), nrow=10)
+
+    """
+    if isinstance(columnnames, six.string_types):
+        columnnames = [columnnames]
+    for name in columnnames:
+        desc = tabdesc[name]
+        vtype = desc['valueType']
+        if vtype not in _compress_engines:
+            raise ValueError('Column ' + name + ' cannot be compressed; '
+                             'only float and complex columns can')
+        if 'ndim' not in desc:
+            raise ValueError('Column ' + name + ' is not an array column')
+        (engine, stored) = _compress_engines[vtype]
+        desc['dataManagerType'] = engine
+        desc['dataManagerGroup'] = name + '_Compress'
+        ndim = desc.get('ndim', 0)
+        shape = desc.get('shape', [])
+        target = makearrcoldesc(name + '_COMPRESSED', 0, ndim, shape,
+                                'TiledShapeStMan' if ndim > 0 else '',
+                                name + '_COMPRESSED' if ndim > 0 else '',
+                                options=desc.get('option', 0),
+                                valuetype=stored)
+        # Keep the axis order of the source column.
+        if '_c_order' in desc:
+            target['desc']['_c_order'] = desc['_c_order']
+        tabdesc[target['name']] = target['desc']
+        for suffix in ('_SCALE', '_OFFSET'):
+            scadesc = makescacoldesc(name + suffix, 0., valuetype='float')
+            tabdesc[scadesc['name']] = scadesc['desc']
+    return tabdesc
+
+
+def _compressspec(column):
+    """Get the spec of the engine compressing the given column."""
+    return {'SOURCENAME': column,
+            'TARGETNAME': column + '_COMPRESSED',
+            'SCALENAME': column + '_SCALE',
+            'OFFSETNAME': column + '_OFFSET',
+            'AUTOSCALE': True}
+
+
 def makedminfo(tabdesc, group_spec=None):
   """Creates a data manager information object.
 
@@ -505,6 +581,10 @@ def makedminfo(tabdesc, group_spec=None):
       }
     This should be used with care.
 
+  The SPEC of the CompressFloat and CompressComplex engines set up by
+  :func:`compresscolumns` is filled in automatically; a `group_spec` for
+  their group is merged into it.
+
   """
   if group_spec is None:
     group_spec = {}
@@ -545,7 +625,11 @@ def makedminfo(tabdesc, group_spec=None):
 
     # Set the spec
     if dm_group.spec is None:
-      dm_group.spec = group_spec.get(group, {})
+      if type_ in [e[0] for e in _compress_engines.values()]:
+        dm_group.spec = _compressspec(c)
+        dm_group.spec.update(group_spec.get(group, {}))
+      else:
+        dm_group.spec = group_spec.get(group, {})
 
     # Check that the data manager type is consistent across columns
     if dm_group.type is None:
@@ -675,7 +759,8 @@ def tableiswritable(tablename):
 
 
 def tablecopy(tablename, newtablename, deep=False, valuecopy=False, dminfo={},
-              endian='aipsrc', memorytable=False, copynorows=False):
+              endian='aipsrc', memorytable=False, copynorows=False,
+              readahead=0):
     """Copy a table.
 
     It is the same as :func:`table.copy`, but without the need to open
@@ -685,7 +770,7 @@ def tablecopy(tablename, newtablename, deep=False, valuecopy=False, dminfo={},
     t = table(tablename, ack=False)
     return t.copy(newtablename, deep=deep, valuecopy=valuecopy,
                   dminfo=dminfo, endian=endian, memorytable=memorytable,
-                  copynorows=copynorows)
+                  copynorows=copynorows, readahead=readahead)
 
 
 def tablerename(tablename, newtablename):
@@ -69,20 +69,23 @@ extension_metas = (
     # name, sources, depends, libraries
     (
         "casacore.fitting._fitting",
-        ["src/fit.cc", "src/fitting.cc"],
-        ["src/fitting.h"],
+        ["src/fit.cc", "src/fitting.cc", "src/fitmany.cc",
+         "src/fitnormeq.cc"],
+        ["src/fitting.h", "src/pygil.h", "src/pythreads.h"],
         ['casa_scimath', 'casa_scimath_f', boost_python, casa_python],
     ),
     (
         "casacore.functionals._functionals",
-        ["src/functional.cc", "src/functionals.cc"],
-        ["src/functionals.h"],
+        ["src/functional.cc", "src/functionals.cc", "src/functionaleval.cc",
+         "src/functionalexpr.cc"],
+        ["src/functionals.h", "src/pygil.h", "src/pythreads.h",
+         "src/pybuffer.h"],
         ['casa_scimath', 'casa_scimath_f', boost_python, casa_python],
     ),
     (
         "casacore.images._images",
         ["src/images.cc", "src/pyimages.cc"],
-        ["src/pyimages.h"],
+        ["src/pyimages.h", "src/pygil.h", "src/pybuffer.h"],
         ['casa_images', 'casa_coordinates',
          'casa_fits', 'casa_lattices', 'casa_measures',
          'casa_scimath', 'casa_scimath_f', 'casa_tables', 'casa_mirlib',
@@ -90,8 +93,9 @@ extension_metas = (
     ),
     (
         "casacore.measures._measures",
-        ["src/pymeas.cc", "src/pymeasures.cc"],
-        ["src/pymeasures.h"],
+        ["src/pymeas.cc", "src/pymeasures.cc", "src/pymeasconv.cc"],
+        ["src/pymeasures.h", "src/pygil.h", "src/pythreads.h",
+         "src/pybuffer.h", "src/pyrecord.h"],
         ['casa_measures', 'casa_scimath', 'casa_scimath_f', 'casa_tables',
          boost_python, casa_python]
     ),
@@ -105,8 +109,10 @@ extension_metas = (
     (
         "casacore.tables._tables",
         ["src/pytable.cc", "src/pytableindex.cc", "src/pytableiter.cc",
-         "src/pytablerow.cc", "src/tables.cc", "src/pyms.cc"],
-        ["src/tables.h"],
+         "src/pytablerow.cc", "src/pytablecopy.cc", "src/tables.cc",
+         "src/pyms.cc"],
+        ["src/tables.h", "src/pybuffer.h", "src/pyrecord.h", "src/pygil.h",
+         "src/pythreads.h"],
         ['casa_tables', 'casa_ms', boost_python, casa_python],
     )
 )
@@ -0,0 +1,298 @@
+//# fitmany.cc: prepared fits and many independent fits in parallel
+//# Copyright (C) 2017
+//# Associated Universities, Inc. Washington DC, USA.
+//#
+//# This library is free software; you can redistribute it and/or modify it
+//# under the terms of the GNU Library General Public License as published by
+//# the Free Software Foundation; either version 2 of the License, or (at your
+//# option) any later version.
+//#
+//# This library is distributed in the hope that it will be useful, but WITHOUT
+//# ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//# FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+//# License for more details.
+//#
+//# You should have received a copy of the GNU Library General Public License
+//# along with this library; if not, write to the Free Software Foundation,
+//# Inc., 675 Massachusetts Ave, Cambridge, MA 02139, USA.
+//#
+//# Correspondence concerning AIPS++ should be addressed as follows:
+//#        Internet email: aips2-request@nrao.edu.
+//#        Postal address: AIPS++ Project Office
+//#                        National Radio Astronomy Observatory
+//#                        520 Edgemont Road
+//#                        Charlottesville, VA 22903-2475 USA
+//#
+//# $Id: $
+
+#include "fitting.h"
+#include "pygil.h"
+#include "pythreads.h"
+
+#include <casacore/scimath/Fitting/NonLinearFitLM.h>
+#include <casacore/scimath/Fitting/LinearFitSVD.h>
+#include <casacore/scimath/Functionals/FunctionHolder.h>
+#include <casacore/scimath/Mathematics/AutoDiff.h>
+#include <casacore/casa/Arrays/Array.h>
+#include <casacore/casa/Arrays/Vector.h>
+#include <casacore/casa/Arrays/Matrix.h>
+#include <casacore/casa/Containers/Record.h>
+#include <casacore/casa/Containers/ValueHolder.h>
+#include <casacore/casa/Exceptions/Error.h>
+#include <casacore/casa/Utilities/CountedPtr.h>
+#include <casacore/python/Converters/PycBasicData.h>
+#include <casacore/python/Converters/PycRecord.h>
+#include <casacore/python/Converters/PycValueHolder.h>
+
+#include <boost/python.hpp>
+#include <boost/python/args.hpp>
+
+#include <vector>
+
+using namespace boost::python;
+
+namespace casacore { namespace python {
+
+  // PreparedFit keeps a fitter with its (AutoDiff) function, so the same
+  // model can be fitted repeatedly without converting the functional record
+  // and creating the fitter and its work arrays for each fit.
+  // An object can be used by one thread at a time only.
+  class PreparedFit
+  {
+  public:
+    PreparedFit (const Record& fnct, Bool linear, uInt mxit, Double colfac);
+
+    uInt npar() const
+      { return itsNpar; }
+    uInt ndim() const
+      { return itsNdim; }
+
+    // Fit y at the points in x (a Vector if ndim=1, otherwise a Matrix
+    // with a row per point) starting at the given parameter values.
+    // The solution and errors are put in the given vectors.
+    void fit (const Vector<Double>& xv, const Matrix<Double>& xm,
+              const Vector<Double>& y, const Vector<Double>& weights,
+              const Vector<Double>& initial,
+              Vector<Double>& sol, Vector<Double>& err,
+              Double& chi2, Bool& converged, uInt& rank);
+
+    // Do a fit for the given numpy arrays. The GIL is released during the
+    // fit. A record with the solution is returned.
+    Record fitArrays (const ValueHolder& x, const ValueHolder& y,
+                      const ValueHolder& wt, const ValueHolder& initial);
+
+    // Convert x to the form needed by the fitter.
+    void makeX (const Array<Double>& x, size_t npts,
+                Vector<Double>& xv, Matrix<Double>& xm) const;
+
+  private:
+    CountedPtr<GenericL2Fit<Double> > itsFitter;
+    NonLinearFitLM<Double>*           itsNLFit;
+    uInt                              itsNpar;
+    uInt                              itsNdim;
+  };
+
+
+  PreparedFit::PreparedFit (const Record& fnct, Bool linear, uInt mxit,
+                            Double colfac)
+    : itsNLFit (0)
+  {
+    FunctionHolder<Double> fh;
+    Function<AutoDiff<Double> >* fn = 0;
+    String error;
+    if (!fh.fromRecord (error, fnct)  ||  !fh.getRecord (error, fn, fnct)) {
+      throw AipsError ("fit: invalid functional: " + error);
+    }
+    CountedPtr<Function<AutoDiff<Double> > > func (fn);
+    itsNpar = func->nparameters();
+    itsNdim = std::max (func->ndim(), 1u);
+    if (linear) {
+      itsFitter = new LinearFitSVD<Double>();
+    } else {
+      itsNLFit = new NonLinearFitLM<Double>();
+      itsNLFit->setMaxIter (mxit);
+      itsFitter = itsNLFit;
+    }
+    itsFitter->setCollinearity (colfac);
+    itsFitter->setFunction (*func);
+  }
+
+  void PreparedFit::fit (const Vector<Double>& xv, const Matrix<Double>& xm,
+                         const Vector<Double>& y,
+                         const Vector<Double>& weights,
+                         const Vector<Double>& initial,
+                         Vector<Double>& sol, Vector<Double>& err,
+                         Double& chi2, Bool& converged, uInt& rank)
+  {
+    itsFitter->setParameterValues (initial);
+    sol = (itsNdim == 1  ?  itsFitter->fit (xv, y, weights)
+                         :  itsFitter->fit (xm, y, weights));
+    err = itsFitter->errors();
+    chi2 = itsFitter->chiSquare();
+    converged = (itsNLFit == 0  ||  itsNLFit->converged());
+    rank = itsFitter->getRank();
+  }
+
+  void PreparedFit::makeX (const Array<Double>& x, size_t npts,
+                           Vector<Double>& xv, Matrix<Double>& xm) const
+  {
+    if (x.size() != npts*itsNdim) {
+      throw AipsError ("fit: x must have ndim*npoints values");
+    }
+    if (itsNdim == 1) {
+      xv.reference (Vector<Double> (x.reform (IPosition(1, npts))));
+    } else {
+      xm.reference (Matrix<Double> (x.reform (IPosition(2, itsNdim, npts)))
+                    .transpose());
+    }
+  }
+
+  Record PreparedFit::fitArrays (const ValueHolder& xvh,
+                                 const ValueHolder& yvh,
+                                 const ValueHolder& wtvh,
+                                 const ValueHolder& initvh)
+  {
+    Vector<Double> y (yvh.asArrayDouble());
+    Array<Double> wt (wtvh.asArrayDouble());
+    Vector<Double> initial (initvh.asArrayDouble());
+    size_t npts = y.size();
+    Vector<Double> xv;
+    Matrix<Double> xm;
+    makeX (xvh.asArrayDouble(), npts, xv, xm);
+    if (initial.size() != itsNpar) {
+      throw AipsError ("fit: invalid number of initial values");
+    }
+    Vector<Double> weights (npts);
+    if (wt.size() == 1) {
+      weights = wt.data()[0];
+    } else if (wt.size() == npts) {
+      weights = Vector<Double> (wt.reform (IPosition(1, npts)));
+    } else {
+      throw AipsError ("fit: wt must have 1 value or 1 per y value");
+    }
+    Vector<Double> sol, err;
+    Double chi2;
+    Bool converged;
+    uInt rank;
+    {
+      ReleaseGIL release;
+      fit (xv, xm, y, weights, initial, sol, err, chi2, converged, rank);
+    }
+    Record result;
+    result.define ("sol", sol);
+    result.define ("error", err);
+    result.define ("chi2", chi2);
+    result.define ("converged", converged);
+    result.define ("rank", rank);
+    return result;
+  }
+
+  // Get the values of an array given per problem, or shared by all
+  // problems (size n), or a single value (size 1).
+  // It returns a pointer to the values and the step between problems.
+  const Double* perProblem (const Array<Double>& arr, size_t n,
+                            size_t nprob, size_t& step, const String& name)
+  {
+    if (arr.size() == n*nprob) {
+      step = n;
+    } else if (arr.size() == n  ||  arr.size() == 1) {
+      step = 0;
+    } else {
+      throw AipsError ("fit_many: invalid number of values in " + name);
+    }
+    return arr.data();
+  }
+
+  // Solve nprob independent problems y[i] = fnct(x; p[i]).
+  // Each thread has its own PreparedFit, which is reused for all problems
+  // it solves.
+  Record fitMany (const Record& fnct, const ValueHolder& xvh,
+                  const ValueHolder& yvh, const ValueHolder& wtvh,
+                  const ValueHolder& initvh, uInt mxit, Bool linear,
+                  Double colfac, uInt nthreads)
+  {
+    Array<Double> y    (yvh.asArrayDouble());
+    Array<Double> wt   (wtvh.asArrayDouble());
+    Array<Double> init (initvh.asArrayDouble());
+    // y has numpy shape [nprob,npts], thus casacore shape (npts,nprob).
+    if (y.ndim() != 2) {
+      throw AipsError ("fit_many: y must be a 2-dim array");
+    }
+    size_t npts  = y.shape()[0];
+    size_t nprob = y.shape()[1];
+    nthreads = std::max (nrThreads (nthreads, nprob), 1u);
+    std::vector<CountedPtr<PreparedFit> > fitters;
+    for (uInt i=0; i<nthreads; ++i) {
+      fitters.push_back (new PreparedFit (fnct, linear, mxit, colfac));
+    }
+    uInt npar = fitters[0]->npar();
+    Vector<Double> xv;
+    Matrix<Double> xm;
+    fitters[0]->makeX (xvh.asArrayDouble(), npts, xv, xm);
+    size_t wtStep, initStep;
+    const Double* wtPtr   = perProblem (wt, npts, nprob, wtStep, "wt");
+    const Double* initPtr = perProblem (init, npar, nprob, initStep,
+                                        "initial");
+    if (init.size() == 1  &&  npar != 1) {
+      throw AipsError ("fit_many: invalid number of initial values");
+    }
+    // Result shapes are in Fortran order: numpy [nprob,npar] and [nprob].
+    Matrix<Double> sol (npar, nprob, 0.);
+    Matrix<Double> err (npar, nprob, 0.);
+    Vector<Double> chi2 (nprob, 0.);
+    Vector<Bool> converged (nprob, False);
+    Vector<uInt> rank (nprob, 0);
+    const Double* yPtr = y.data();
+    {
+      ReleaseGIL release;
+      runParts (nprob, nthreads, [&] (uInt thr, size_t st, size_t end) {
+        Vector<Double> weights (npts);
+        Vector<Double> pars (npar);
+        Vector<Double> s, e;
+        for (size_t i=st; i<end; ++i) {
+          Vector<Double> yv (IPosition(1, npts),
+                             const_cast<Double*>(yPtr + i*npts), SHARE);
+          const Double* wp = wtPtr + i*wtStep;
+          for (size_t j=0; j<npts; ++j) {
+            weights[j] = (wt.size() == 1  ?  wp[0] : wp[j]);
+          }
+          for (uInt j=0; j<npar; ++j) {
+            pars[j] = initPtr[i*initStep + (init.size() == 1 ? 0 : j)];
+          }
+          fitters[thr]->fit (xv, xm, yv, weights, pars, s, e,
+                             chi2[i], converged[i], rank[i]);
+          sol.column(i) = s;
+          err.column(i) = e;
+        }
+      });
+    }
+    Record result;
+    result.define ("sol", sol);
+    result.define ("error", err);
+    result.define ("chi2", chi2);
+    result.define ("converged", converged);
+    result.define ("rank", rank);
+    return result;
+  }
+
+  void fitmany()
+  {
+    def ("_fit_many", &fitMany,
+         (boost::python::arg("fnct"),
+          boost::python::arg("x"),
+          boost::python::arg("y"),
+          boost::python::arg("wt"),
+          boost::python::arg("initial"),
+          boost::python::arg("mxit"),
+          boost::python::arg("linear"),
+          boost::python::arg("colfac"),
+          boost::python::arg("nthreads")));
+    class_<PreparedFit> ("_preparedfit",
+                         init<Record, Bool, uInt, Double>())
+      .def ("npar", &PreparedFit::npar)
+      .def ("ndim", &PreparedFit::ndim)
+      .def ("_fit", &PreparedFit::fitArrays)
+      ;
+  }
+
+} }
@@ -0,0 +1,227 @@
+//# fitnormeq.cc: incremental linear least squares with normal equations
+//# Copyright (C) 2017
+//# Associated Universities, Inc. Washington DC, USA.
+//#
+//# This library is free software; you can redistribute it and/or modify it
+//# under the terms of the GNU Library General Public License as published by
+//# the Free Software Foundation; either version 2 of the License, or (at your
+//# option) any later version.
+//#
+//# This library is distributed in the hope that it will be useful, but WITHOUT
+//# ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//# FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+//# License for more details.
+//#
+//# You should have received a copy of the GNU Library General Public License
+//# along with this library; if not, write to the Free Software Foundation,
+//# Inc., 675 Massachusetts Ave, Cambridge, MA 02139, USA.
+//#
+//# Correspondence concerning AIPS++ should be addressed as follows:
+//#        Internet email: aips2-request@nrao.edu.
+//#        Postal address: AIPS++ Project Office
+//#                        National Radio Astronomy Observatory
+//#                        520 Edgemont Road
+//#                        Charlottesville, VA 22903-2475 USA
+//#
+//# $Id: $
+
+#include "fitting.h"
+#include "pygil.h"
+
+#include <casacore/scimath/Fitting/LSQFit.h>
+#include <casacore/scimath/Functionals/FunctionHolder.h>
+#include <casacore/casa/Arrays/Array.h>
+#include <casacore/casa/Arrays/Vector.h>
+#include <casacore/casa/Arrays/Matrix.h>
+#include <casacore/casa/Containers/Record.h>
+#include <casacore/casa/Containers/ValueHolder.h>
+#include <casacore/casa/Exceptions/Error.h>
+#include <casacore/casa/Utilities/CountedPtr.h>
+#include <casacore/python/Converters/PycBasicData.h>
+#include <casacore/python/Converters/PycRecord.h>
+#include <casacore/python/Converters/PycValueHolder.h>
+
+#include <boost/python.hpp>
+
+#include <algorithm>
+
+using namespace boost::python;
+
+namespace casacore { namespace python {
+
+  // NormalEquations holds the normal equations of a linear least squares
+  // problem for a functional that is linear in its parameters. Condition
+  // equations can be added in chunks (accumulate), so the data never
+  // have to be in memory at once. Normal equations built from different
+  // parts of the data (e.g. in parallel) can be merged before solving.
+  class NormalEquations
+  {
+  public:
+    explicit NormalEquations (const Record& fnct);
+
+    uInt npar() const
+      { return itsNpar; }
+    Double nequations() const
+      { return itsNeq; }
+
+    // Add the condition equations for the points in x with observed values
+    // y and weights wt (one value per point or a single value).
+    void accumulate (const ValueHolder& x, const ValueHolder& y,
+                     const ValueHolder& wt);
+
+    // Add the normal equations of another object for the same functional.
+    void merge (const NormalEquations& other);
+
+    // Solve the normal equations. They are not changed, so more equations
+    // can be added and solved again.
+    Record solve (Double colfac) const;
+
+    // Get or set the state as a record (e.g. to send it to another process).
+    Record toRecord() const;
+    void fromRecord (const Record& rec);
+
+  private:
+    Record                           itsFnct;
+    CountedPtr<Function<Double> >    itsFunc;
+    uInt                             itsNpar;
+    uInt                             itsNdim;
+    Double                           itsNeq;
+    LSQFit                           itsFit;
+  };
+
+
+  NormalEquations::NormalEquations (const Record& fnct)
+    : itsFnct (fnct),
+      itsNeq  (0)
+  {
+    FunctionHolder<Double> fh;
+    Function<Double>* fn = 0;
+    String error;
+    if (!fh.fromRecord (error, fnct)  ||  !fh.getRecord (error, fn, fnct)) {
+      throw AipsError ("normeq: invalid functional: " + error);
+    }
+    itsFunc = CountedPtr<Function<Double> > (fn);
+    itsNpar = itsFunc->nparameters();
+    itsNdim = std::max (itsFunc->ndim(), 1u);
+    itsFit.set (itsNpar);
+  }
+
+  void NormalEquations::accumulate (const ValueHolder& xvh,
+                                    const ValueHolder& yvh,
+                                    const ValueHolder& wtvh)
+  {
+    Array<Double> x  (xvh.asArrayDouble());
+    Array<Double> y  (yvh.asArrayDouble());
+    Array<Double> wt (wtvh.asArrayDouble());
+    size_t npts = y.size();
+    if (x.size() != npts*itsNdim) {
+      throw AipsError ("normeq: x must have ndim values per y value");
+    }
+    if (wt.size() != npts  &&  wt.size() != 1) {
+      throw AipsError ("normeq: wt must have 1 value or 1 per y value");
+    }
+    const Double* xPtr  = x.data();
+    const Double* yPtr  = y.data();
+    const Double* wtPtr = wt.data();
+    ReleaseGIL release;
+    // The functional is linear in its parameters, so the coefficients of
+    // the condition equation are f(x;e_i) - f(x;0), where e_i is the unit
+    // vector for parameter i. f(x;0) is the part not depending on the
+    // parameters, which is subtracted from the observed value.
+    Vector<Double> pars (itsNpar, 0.);
+    Vector<Double> cEq (itsNpar);
+    Vector<Double> xv (itsNdim);
+    Function<Double>& func = *itsFunc;
+    for (uInt i=0; i<itsNpar; ++i) {
+      func[i] = 0;
+    }
+    for (size_t j=0; j<npts; ++j) {
+      for (uInt k=0; k<itsNdim; ++k) {
+        xv[k] = xPtr[j*itsNdim + k];
+      }
+      Double f0 = func(xv);
+      for (uInt i=0; i<itsNpar; ++i) {
+        func[i] = 1;
+        cEq[i] = func(xv) - f0;
+        func[i] = 0;
+      }
+      itsFit.makeNorm (cEq.data(), wtPtr[wt.size() == 1 ? 0 : j],
+                       yPtr[j] - f0);
+    }
+    itsNeq += npts;
+  }
+
+  void NormalEquations::merge (const NormalEquations& other)
+  {
+    if (other.itsNpar != itsNpar  ||  !itsFit.merge (other.itsFit)) {
+      throw AipsError ("normeq: cannot merge normal equations with a "
+                       "different number of unknowns");
+    }
+    itsNeq += other.itsNeq;
+  }
+
+  Record NormalEquations::solve (Double colfac) const
+  {
+    LSQFit fit (itsFit);
+    fit.set (colfac);
+    uInt rank;
+    Bool ok = fit.invert (rank, True);
+    Vector<Double> sol (itsNpar, 0.);
+    Vector<Double> err (itsNpar, 0.);
+    Matrix<Double> covar (itsNpar, itsNpar, 0.);
+    if (ok) {
+      fit.solve (sol.data());
+      fit.getErrors (err.data());
+      fit.getCovariance (covar.data());
+    }
+    Record rec;
+    rec.define ("sol", sol);
+    rec.define ("error", err);
+    rec.define ("covar", covar);
+    rec.define ("rank", rank);
+    rec.define ("deficiency", fit.getDeficiency());
+    rec.define ("chi2", fit.getChi());
+    rec.define ("sd", fit.getSD());
+    rec.define ("mu", fit.getWeightedSD());
+    rec.define ("ok", ok);
+    return rec;
+  }
+
+  Record NormalEquations::toRecord() const
+  {
+    Record lsq;
+    String error;
+    if (!itsFit.toRecord (error, lsq)) {
+      throw AipsError ("normeq: " + error);
+    }
+    Record rec;
+    rec.defineRecord ("fnct", itsFnct);
+    rec.defineRecord ("lsq", lsq);
+    rec.define ("neq", itsNeq);
+    return rec;
+  }
+
+  void NormalEquations::fromRecord (const Record& rec)
+  {
+    String error;
+    if (!itsFit.fromRecord (error, rec.asRecord("lsq"))) {
+      throw AipsError ("normeq: " + error);
+    }
+    itsNeq = rec.asDouble ("neq");
+  }
+
+
+  void fitnormeq()
+  {
+    class_<NormalEquations> ("_normeq", init<Record>())
+      .def ("npar", &NormalEquations::npar)
+      .def ("nequations", &NormalEquations::nequations)
+      .def ("_accumulate", &NormalEquations::accumulate)
+      .def ("_merge", &NormalEquations::merge)
+      .def ("_solve", &NormalEquations::solve)
+      .def ("_todict", &NormalEquations::toRecord)
+      .def ("_fromdict", &NormalEquations::fromRecord)
+      ;
+  }
+
+} }
@@ -34,11 +34,15 @@
 #include <casacore/python/Converters/PycBasicData.h>
 #include <casacore/python/Converters/PycRecord.h>
 #include <casacore/python/Converters/PycArray.h>
+#include <casacore/python/Converters/PycValueHolder.h>
 
 BOOST_PYTHON_MODULE(_fitting)
 {
   casa::python::register_convert_excp();
   casa::python::register_convert_basicdata();
   casa::python::register_convert_casa_record();
+  casa::python::register_convert_casa_valueholder();
   casa::python::fit();
+  casa::python::fitmany();
+  casa::python::fitnormeq();
 }
@@ -33,6 +33,8 @@
 namespace casacore {
   namespace python {
     void fit();
+    void fitmany();
+    void fitnormeq();
   } // python
 } //casa
 
@@ -0,0 +1,190 @@
+//# functionaleval.cc: fast evaluation of built-in functionals on arrays
+//# Copyright (C) 2017
+//# Associated Universities, Inc. Washington DC, USA.
+//#
+//# This library is free software; you can redistribute it and/or modify it
+//# under the terms of the GNU Library General Public License as published by
+//# the Free Software Foundation; either version 2 of the License, or (at your
+//# option) any later version.
+//#
+//# This library is distributed in the hope that it will be useful, but WITHOUT
+//# ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//# FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+//# License for more details.
+//#
+//# You should have received a copy of the GNU Library General Public License
+//# along with this library; if not, write to the Free Software Foundation,
+//# Inc., 675 Massachusetts Ave, Cambridge, MA 02139, USA.
+//#
+//# Correspondence concerning AIPS++ should be addressed as follows:
+//#        Internet email: aips2-request@nrao.edu.
+//#        Postal address: AIPS++ Project Office
+//#                        National Radio Astronomy Observatory
+//#                        520 Edgemont Road
+//#                        Charlottesville, VA 22903-2475 USA
+//#
+//# $Id: $
+
+#include "functionals.h"
+#include "pygil.h"
+#include "pythreads.h"
+#include "pybuffer.h"
+
+#include <casacore/casa/Arrays/Array.h>
+#include <casacore/casa/Arrays/Vector.h>
+#include <casacore/casa/Containers/ValueHolder.h>
+#include <casacore/casa/Exceptions/Error.h>
+#include <casacore/casa/BasicSL/String.h>
+#include <casacore/python/Converters/PycBasicData.h>
+#include <casacore/python/Converters/PycValueHolder.h>
+
+#include <boost/python.hpp>
+
+#include <cmath>
+
+using namespace boost::python;
+
+namespace casacore { namespace python {
+
+  // Only use multiple threads if there are at least this many points.
+  const size_t theirMinPointsPerThread = 65536;
+
+  // The functions below add the values of a 1-dim built-in functional to
+  // out[0..n-1]. Each is a plain loop over the points, so the compiler can
+  // vectorize it; no virtual function is called per point.
+
+  void addGaussian1D (const Double* p, const Double* x, Double* out, size_t n)
+  {
+    // p = height, center, width (FWHM).
+    const Double height = p[0];
+    const Double center = p[1];
+    const Double fac    = -4. * std::log(2.) / (p[2] * p[2]);
+    for (size_t i=0; i<n; ++i) {
+      Double d = x[i] - center;
+      out[i] += height * std::exp (fac * d * d);
+    }
+  }
+
+  // Add sum(p[j] * x^(step*j+first)) using Horner's scheme in x^step.
+  void addPoly (const Double* p, uInt npar, uInt first, uInt step,
+                const Double* x, Double* out, size_t n)
+  {
+    if (npar == 0) {
+      return;
+    }
+    for (size_t i=0; i<n; ++i) {
+      Double xs = (step == 1  ?  x[i] : x[i]*x[i]);
+      Double sum = p[npar-1];
+      for (Int j=npar-2; j>=0; --j) {
+        sum = sum*xs + p[j];
+      }
+      out[i] += (first == 0  ?  sum : sum*x[i]);
+    }
+  }
+
+  // Add a Chebyshev series using Clenshaw's recurrence. Outside the
+  // interval the default value is used (intervalMode 'constant').
+  void addChebyshev (const Double* p, uInt npar, const Double* interval,
+                     const Double* x, Double* out, size_t n)
+  {
+    const Double xmin = interval[0];
+    const Double xmax = interval[1];
+    const Double def  = interval[2];
+    for (size_t i=0; i<n; ++i) {
+      if (x[i] < xmin  ||  x[i] > xmax) {
+        out[i] += def;
+      } else {
+        Double t = (2.*x[i] - (xmin+xmax)) / (xmax-xmin);
+        Double y1 = 0;
+        Double y2 = 0;
+        for (Int j=npar-1; j>0; --j) {
+          Double tmp = 2.*t*y1 - y2 + p[j];
+          y2 = y1;
+          y1 = tmp;
+        }
+        out[i] += t*y1 - y2 + p[0];
+      }
+    }
+  }
+
+  // Evaluate the sum of the given components for n points.
+  void evalComponents (const Vector<String>& names, const Vector<Int>& npars,
+                       const Vector<Double>& intervals, const Double* params,
+                       const Double* x, Double* out, size_t n)
+  {
+    std::fill (out, out+n, 0.);
+    const Double* p = params;
+    for (uInt i=0; i<names.size(); ++i) {
+      const String& name = names[i];
+      if (name == "gaussian1d") {
+        addGaussian1D (p, x, out, n);
+      } else if (name == "poly") {
+        addPoly (p, npars[i], 0, 1, x, out, n);
+      } else if (name == "evenpoly") {
+        addPoly (p, npars[i], 0, 2, x, out, n);
+      } else if (name == "oddpoly") {
+        addPoly (p, npars[i], 1, 2, x, out, n);
+      } else if (name == "chebyshev") {
+        addChebyshev (p, npars[i], intervals.data() + 3*i, x, out, n);
+      } else {
+        throw AipsError ("No fast evaluation for functional " + name);
+      }
+      p += npars[i];
+    }
+  }
+
+  // Evaluate a sum of built-in 1-dim functionals for all values in x.
+  // The parameters of the components are concatenated in params;
+  // intervals holds (xmin,xmax,default) per component (used for chebyshev).
+  // The result has the shape of x.
+  boost::python::object fastEval (const Vector<String>& names,
+                                  const Vector<Int>& npars,
+                                  const Vector<Double>& intervals,
+                                  const Vector<Double>& params,
+                                  PyObject* xobj, uInt nthreads)
+  {
+    if (npars.size() != names.size()  ||
+        intervals.size() != 3*names.size()) {
+      throw AipsError ("fastEval: mismatching number of components");
+    }
+    uInt nparTotal = 0;
+    for (uInt i=0; i<npars.size(); ++i) {
+      nparTotal += npars[i];
+    }
+    if (params.size() != nparTotal) {
+      throw AipsError ("fastEval: mismatching number of parameters");
+    }
+    // Use the numpy memory of x and result directly.
+    BorrowedArray<Double> xarr (xobj);
+    const Array<Double>& x = xarr.array();
+    Array<Double> result (x.shape());
+    Bool deleteX, deleteRes;
+    const Double* xPtr = x.getStorage (deleteX);
+    Double* resPtr = result.getStorage (deleteRes);
+    // Copy the parameters, so they are contiguous.
+    Vector<Double> pars (params.copy());
+    size_t n = x.size();
+    {
+      ReleaseGIL release;
+      nthreads = nrThreads (nthreads, n / theirMinPointsPerThread);
+      if (nthreads <= 1) {
+        evalComponents (names, npars, intervals, pars.data(),
+                        xPtr, resPtr, n);
+      } else {
+        runParts (n, nthreads, [&] (uInt, size_t st, size_t end) {
+          evalComponents (names, npars, intervals, pars.data(),
+                          xPtr+st, resPtr+st, end-st);
+        });
+      }
+    }
+    x.freeStorage (xPtr, deleteX);
+    result.putStorage (resPtr, deleteRes);
+    return arrayToPython (result);
+  }
+
+  void functionaleval()
+  {
+    def ("_fasteval", &fastEval);
+  }
+
+} }
@@ -0,0 +1,764 @@
+//# functionalexpr.cc: array evaluation of compiled functional expressions
+//# Copyright (C) 2017
+//# Associated Universities, Inc. Washington DC, USA.
+//#
+//# This library is free software; you can redistribute it and/or modify it
+//# under the terms of the GNU Library General Public License as published by
+//# the Free Software Foundation; either version 2 of the License, or (at your
+//# option) any later version.
+//#
+//# This library is distributed in the hope that it will be useful, but WITHOUT
+//# ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//# FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+//# License for more details.
+//#
+//# You should have received a copy of the GNU Library General Public License
+//# along with this library; if not, write to the Free Software Foundation,
+//# Inc., 675 Massachusetts Ave, Cambridge, MA 02139, USA.
+//#
+//# Correspondence concerning AIPS++ should be addressed as follows:
+//#        Internet email: aips2-request@nrao.edu.
+//#        Postal address: AIPS++ Project Office
+//#                        National Radio Astronomy Observatory
+//#                        520 Edgemont Road
+//#                        Charlottesville, VA 22903-2475 USA
+//#
+//# $Id: $
+
+#include "functionals.h"
+#include "pygil.h"
+#include "pythreads.h"
+#include "pybuffer.h"
+
+#include <casacore/casa/Arrays/Array.h>
+#include <casacore/casa/Arrays/Vector.h>
+#include <casacore/casa/Containers/ValueHolder.h>
+#include <casacore/casa/Exceptions/Error.h>
+#include <casacore/casa/BasicSL/String.h>
+#include <casacore/casa/BasicSL/Constants.h>
+#include <casacore/python/Converters/PycBasicData.h>
+#include <casacore/python/Converters/PycValueHolder.h>
+
+#include <boost/python.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+using namespace boost::python;
+
+namespace casacore { namespace python {
+
+  // ExprKernel compiles the expression of a compiled functional (the
+  // CompiledFunction syntax) once into a postfix program, which is
+  // executed for blocks of points at a time. Each stack entry holds a
+  // block of values and, for fdf, the derivatives with respect to all
+  // parameters (forward mode dual numbers), so the interpretation cost is
+  // paid once per block instead of once per point.
+  // Only a subset of the syntax is supported: constructs of which the
+  // meaning in CompiledFunction is not certain (such as chained
+  // comparisons, mixed && and ||, a^b^c, and nested conditionals without
+  // parentheses) are rejected when parsing. An AipsError is thrown for
+  // them, in which case the caller should use FunctionalProxy.
+  // The derivatives follow AutoDiff: a value not depending on the
+  // parameters has no derivatives, so it does not contribute derivative
+  // terms (e.g. sqrt(x) at x=0 does not give 0*inf). This dependency is
+  // known when parsing, so it is kept in the instructions.
+  class ExprKernel
+  {
+  public:
+    explicit ExprKernel (const String& expr);
+
+    uInt ndim() const
+      { return itsNdim; }
+    uInt npar() const
+      { return itsNpar; }
+
+    // Evaluate the function for all points in x (ndim values per point).
+    boost::python::object f (PyObject* x, const Vector<Double>& params,
+                             uInt nthreads) const
+      { return eval (x, params, nthreads, False); }
+
+    // Evaluate the function and its derivatives with respect to the
+    // parameters. The result has shape [npoints, npar+1].
+    boost::python::object fdf (PyObject* x, const Vector<Double>& params,
+                               uInt nthreads) const
+      { return eval (x, params, nthreads, True); }
+
+  private:
+    enum Op {CONST, XVAR, PVAR, NEG, NOT, ADD, SUB, MUL, DIV, POW,
+             EQ, NE, LT, LE, GT, GE, AND, OR, COND, FUNC1, FUNC2};
+    enum Func {SIN, COS, TAN, ASIN, ACOS, ATAN, EXP, LOG, LOG10, SQRT,
+               SINH, COSH, TANH, ABS, FLOOR, CEIL, SQUARE, CUBE,
+               ATAN2, FPOW, FMOD, MIN, MAX};
+    struct Instr
+    {
+      Op     op;
+      Int    arg;
+      Double value;
+      // Tell if the operands and result depend on the parameters.
+      Bool   aDep;
+      Bool   bDep;
+      Bool   dep;
+    };
+    // The number of points evaluated at a time.
+    enum {BLOCK=128};
+
+    // The recursive descent parser producing the postfix program.
+    void parseCond();
+    void parseLogical();
+    void parseCompare();
+    void parseAdd();
+    void parseMul();
+    void parseUnary();
+    void parsePower();
+    void parsePrimary();
+    Int  parseIndex (Int deflt);
+    void skipSpace();
+    Bool accept (const char* token);
+    void expect (const char* token);
+    void emit (Op op, Int arg=0, Double value=0);
+    void error (const String& msg) const;
+
+    boost::python::object eval (PyObject* x, const Vector<Double>& params,
+                                uInt nthreads, Bool withDeriv) const;
+    void evalBlock (const Double* x, const Double* params, size_t n,
+                    uInt width, Double* stack, Double* tmp,
+                    Double* out) const;
+
+    String              itsExpr;
+    size_t              itsPos;
+    std::vector<Instr>  itsCode;
+    // The parameter dependency of the stack entries while parsing.
+    std::vector<Bool>   itsDeps;
+    Int                 itsDepth;
+    Int                 itsMaxDepth;
+    uInt                itsNdim;
+    uInt                itsNpar;
+  };
+
+
+  ExprKernel::ExprKernel (const String& expr)
+    : itsExpr     (expr),
+      itsPos      (0),
+      itsDepth    (0),
+      itsMaxDepth (0),
+      itsNdim     (0),
+      itsNpar     (0)
+  {
+    parseCond();
+    skipSpace();
+    if (itsPos != itsExpr.size()) {
+      error ("unexpected character");
+    }
+  }
+
+  void ExprKernel::error (const String& msg) const
+  {
+    throw AipsError ("Compiled functional '" + itsExpr +
+                     "' not supported by array evaluation: " + msg +
+                     " at position " + String::toString(itsPos));
+  }
+
+  void ExprKernel::skipSpace()
+  {
+    while (itsPos < itsExpr.size()  &&  isspace(itsExpr[itsPos])) {
+      ++itsPos;
+    }
+  }
+
+  Bool ExprKernel::accept (const char* token)
+  {
+    skipSpace();
+    size_t len = strlen(token);
+    if (itsExpr.compare (itsPos, len, token) != 0) {
+      return False;
+    }
+    // Do not take the first character of a two character operator.
+    if (len == 1  &&  itsPos+1 < itsExpr.size()) {
+      char next = itsExpr[itsPos+1];
+      if (next == '='  &&  strchr("=!<>", token[0])) {
+        return False;
+      }
+      if ((token[0] == '&'  ||  token[0] == '|')  &&  next == token[0]) {
+        return False;
+      }
+    }
+    itsPos += len;
+    return True;
+  }
+
+  void ExprKernel::expect (const char* token)
+  {
+    if (!accept (token)) {
+      error (String("expected ") + token);
+    }
+  }
+
+  void ExprKernel::emit (Op op, Int arg, Double value)
+  {
+    Instr instr = {op, arg, value, False, False, False};
+    // Keep track of the stack depth needed and the parameter dependency.
+    switch (op) {
+    case CONST:
+    case XVAR:
+      itsDeps.push_back (False);
+      break;
+    case PVAR:
+      itsDeps.push_back (True);
+      break;
+    case NEG:
+    case FUNC1:
+      instr.aDep = instr.dep = itsDeps.back();
+      break;
+    case NOT:
+      itsDeps.back() = False;
+      break;
+    case COND:
+      {
+        instr.bDep = itsDeps[itsDeps.size()-1];
+        instr.aDep = itsDeps[itsDeps.size()-2];
+        // Otherwise the dependency would differ per point.
+        if (instr.aDep != instr.bDep) {
+          error ("both results of a conditional expression must depend "
+                 "on the parameters or not");
+        }
+        instr.dep = instr.aDep;
+        itsDeps.resize (itsDeps.size() - 3);
+        itsDeps.push_back (instr.dep);
+      }
+      break;
+    default:
+      instr.bDep = itsDeps.back();
+      itsDeps.pop_back();
+      instr.aDep = itsDeps.back();
+      // Comparisons and logical operators give a constant 0 or 1.
+      instr.dep = (op == EQ  ||  op == NE  ||  op == LT  ||  op == LE  ||
+                   op == GT  ||  op == GE  ||  op == AND  ||  op == OR)  ?
+        False : (instr.aDep || instr.bDep);
+      itsDeps.back() = instr.dep;
+      break;
+    }
+    itsCode.push_back (instr);
+    itsDepth = Int(itsDeps.size());
+    itsMaxDepth = std::max (itsMaxDepth, itsDepth);
+  }
+
+  // A nested conditional needs parentheses.
+  void ExprKernel::parseCond()
+  {
+    parseLogical();
+    if (accept ("?")) {
+      parseLogical();
+      expect (":");
+      parseLogical();
+      emit (COND);
+      if (accept ("?")) {
+        error ("nested conditional expressions need parentheses");
+      }
+    }
+  }
+
+  // && and || cannot be mixed without parentheses.
+  void ExprKernel::parseLogical()
+  {
+    parseCompare();
+    const char* token = (accept ("&&") ? "&&" : accept ("||") ? "||" : 0);
+    if (token) {
+      Op op = (token[0] == '&' ? AND : OR);
+      do {
+        parseCompare();
+        emit (op);
+      } while (accept (token));
+      if (accept (op == AND ? "||" : "&&")) {
+        error ("mixed && and || need parentheses");
+      }
+    }
+  }
+
+  // Comparisons cannot be chained without parentheses.
+  void ExprKernel::parseCompare()
+  {
+    static const char* const tokens[] = {"==", "!=", "<=", ">=", "<", ">", 0};
+    static const Op ops[] = {EQ, NE, LE, GE, LT, GT};
+    parseAdd();
+    for (Int i=0; tokens[i]; ++i) {
+      if (accept (tokens[i])) {
+        parseAdd();
+        emit (ops[i]);
+        for (Int j=0; tokens[j]; ++j) {
+          if (accept (tokens[j])) {
+            error ("chained comparisons need parentheses");
+          }
+        }
+        break;
+      }
+    }
+  }
+
+  void ExprKernel::parseAdd()
+  {
+    parseMul();
+    while (True) {
+      if (accept ("+")) {
+        parseMul();
+        emit (ADD);
+      } else if (accept ("-")) {
+        parseMul();
+        emit (SUB);
+      } else {
+        break;
+      }
+    }
+  }
+
+  void ExprKernel::parseMul()
+  {
+    parseUnary();
+    while (True) {
+      if (accept ("*")) {
+        parseUnary();
+        emit (MUL);
+      } else if (accept ("/")) {
+        parseUnary();
+        emit (DIV);
+      } else {
+        break;
+      }
+    }
+  }
+
+  void ExprKernel::parseUnary()
+  {
+    if (accept ("-")) {
+      parseUnary();
+      emit (NEG);
+    } else if (accept ("+")) {
+      parseUnary();
+    } else if (accept ("!")) {
+      parseUnary();
+      emit (NOT);
+    } else {
+      parsePower();
+    }
+  }
+
+  // The exponent must be a primary (e.g. x^-1 and a^b^c need parentheses).
+  void ExprKernel::parsePower()
+  {
+    parsePrimary();
+    if (accept ("^")) {
+      parsePrimary();
+      emit (POW);
+      if (accept ("^")) {
+        error ("a^b^c needs parentheses");
+      }
+    }
+  }
+
+  // Parse the index of p or x as p3 or p[3] (which is one-based).
+  Int ExprKernel::parseIndex (Int deflt)
+  {
+    if (itsPos < itsExpr.size()  &&  isdigit(itsExpr[itsPos])) {
+      Int index = 0;
+      while (itsPos < itsExpr.size()  &&  isdigit(itsExpr[itsPos])) {
+        index = 10*index + (itsExpr[itsPos++] - '0');
+      }
+      return index;
+    }
+    if (accept ("[")) {
+      skipSpace();
+      if (itsPos >= itsExpr.size()  ||  !isdigit(itsExpr[itsPos])) {
+        error ("only constant indices are supported");
+      }
+      Int index = 0;
+      while (itsPos < itsExpr.size()  &&  isdigit(itsExpr[itsPos])) {
+        index = 10*index + (itsExpr[itsPos++] - '0');
+      }
+      expect ("]");
+      if (index < 1) {
+        error ("index must be at least 1");
+      }
+      return index - 1;
+    }
+    return deflt;
+  }
+
+  void ExprKernel::parsePrimary()
+  {
+    skipSpace();
+    if (itsPos >= itsExpr.size()) {
+      error ("unexpected end");
+    }
+    char c = itsExpr[itsPos];
+    if (accept ("(")) {
+      parseCond();
+      expect (")");
+      return;
+    }
+    if (isdigit(c)  ||  c == '.') {
+      const char* start = itsExpr.chars() + itsPos;
+      char* end;
+      Double value = strtod (start, &end);
+      if (end == start) {
+        error ("invalid number");
+      }
+      itsPos += end - start;
+      emit (CONST, 0, value);
+      return;
+    }
+    if (!isalpha(c)) {
+      error ("unexpected character");
+    }
+    size_t st = itsPos;
+    while (itsPos < itsExpr.size()  &&  isalpha(itsExpr[itsPos])) {
+      ++itsPos;
+    }
+    String name = itsExpr.substr (st, itsPos-st);
+    if (name == "p") {
+      Int index = parseIndex (0);
+      itsNpar = std::max (itsNpar, uInt(index+1));
+      emit (PVAR, index);
+      return;
+    }
+    if (name == "x") {
+      Int index = parseIndex (0);
+      itsNdim = std::max (itsNdim, uInt(index+1));
+      emit (XVAR, index);
+      return;
+    }
+    if (name == "pi"  ||  name == "ee") {
+      // A constant, optionally multiplied by the argument.
+      emit (CONST, 0, name == "pi" ? C::pi : C::e);
+      if (accept ("(")) {
+        if (!accept (")")) {
+          parseCond();
+          expect (")");
+          emit (MUL);
+        }
+      }
+      return;
+    }
+    static const char* const names1[] = {
+      "sin", "cos", "tan", "asin", "acos", "atan", "exp", "log", "log10",
+      "sqrt", "sinh", "cosh", "tanh", "abs", "floor", "ceil", "square",
+      "cube", 0};
+    static const char* const names2[] = {"atan2", "pow", "fmod", "min", "max",
+                                         0};
+    // log10 and atan2 have digits in their names.
+    if (name == "log"  &&  itsExpr.compare (itsPos, 2, "10") == 0) {
+      name = "log10";
+      itsPos += 2;
+    } else if (name == "atan"  &&  itsExpr.compare (itsPos, 1, "2") == 0) {
+      name = "atan2";
+      itsPos += 1;
+    }
+    Int func = -1;
+    Int nargs = 0;
+    for (Int i=0; names1[i]; ++i) {
+      if (name == names1[i]) {
+        func = i;
+        nargs = 1;
+      }
+    }
+    for (Int i=0; names2[i]; ++i) {
+      if (name == names2[i]) {
+        func = ATAN2 + i;
+        nargs = 2;
+      }
+    }
+    if (func < 0) {
+      error ("unknown function " + name);
+    }
+    expect ("(");
+    parseCond();
+    if (accept (",")) {
+      parseCond();
+      if (func == ATAN) {
+        func = ATAN2;
+      } else if (nargs != 2) {
+        error ("too many arguments for " + name);
+      }
+      nargs = 2;
+    } else if (nargs == 2) {
+      error ("too few arguments for " + name);
+    }
+    expect (")");
+    emit (nargs == 1 ? FUNC1 : FUNC2, func);
+  }
+
+  // Execute the program for n points (n <= BLOCK). Each stack entry
+  // holds width*BLOCK values: the values of the points followed by the
+  // derivatives for each parameter. The result is written to out as
+  // out[point*width + deriv].
+  // The derivatives of an entry not depending on the parameters are zero
+  // and are not calculated.
+  void ExprKernel::evalBlock (const Double* x, const Double* params,
+                              size_t n, uInt width, Double* stack,
+                              Double* tmp, Double* out) const
+  {
+    const size_t entry = width*BLOCK;
+    // The number of entries on the stack.
+    size_t nstack = 0;
+    for (size_t ic=0; ic<itsCode.size(); ++ic) {
+      const Instr& instr = itsCode[ic];
+      switch (instr.op) {
+      case CONST:
+      case XVAR:
+      case PVAR:
+        {
+          Double* top = stack + nstack*entry;
+          ++nstack;
+          for (size_t j=0; j<n; ++j) {
+            top[j] = (instr.op == CONST  ?  instr.value :
+                      instr.op == XVAR   ?  x[j*itsNdim + instr.arg] :
+                                            params[instr.arg]);
+          }
+          for (uInt d=1; d<width; ++d) {
+            Double deriv = (instr.op == PVAR  &&  Int(d) == instr.arg+1);
+            std::fill (top + d*BLOCK, top + d*BLOCK + n, deriv);
+          }
+        }
+        break;
+      case NEG:
+        {
+          Double* top = stack + (nstack-1)*entry;
+          for (uInt d=0; d<(instr.dep ? width : 1); ++d) {
+            for (size_t j=0; j<n; ++j) {
+              top[d*BLOCK + j] = -top[d*BLOCK + j];
+            }
+          }
+        }
+        break;
+      case NOT:
+        {
+          Double* top = stack + (nstack-1)*entry;
+          for (size_t j=0; j<n; ++j) {
+            top[j] = (top[j] == 0);
+          }
+          std::fill (top + BLOCK, top + width*BLOCK, 0.);
+        }
+        break;
+      case COND:
+        {
+          Double* c = stack + (nstack-3)*entry;
+          Double* t = c + entry;
+          Double* f = t + entry;
+          nstack -= 2;
+          // Do the values last, because they hold the condition.
+          for (Int d=width-1; d>=0; --d) {
+            for (size_t j=0; j<n; ++j) {
+              c[d*BLOCK + j] = (c[j] != 0  ?  t[d*BLOCK + j]
+                                           :  f[d*BLOCK + j]);
+            }
+          }
+        }
+        break;
+      case FUNC1:
+        {
+          Double* a = stack + (nstack-1)*entry;
+          for (size_t j=0; j<n; ++j) {
+            Double v = a[j];
+            Double r, dr;
+            switch (instr.arg) {
+            case SIN:    r = sin(v);   dr = cos(v);            break;
+            case COS:    r = cos(v);   dr = -sin(v);           break;
+            case TAN:    r = tan(v);   dr = 1 + r*r;           break;
+            case ASIN:   r = asin(v);  dr = 1 / sqrt(1 - v*v); break;
+            case ACOS:   r = acos(v);  dr = -1 / sqrt(1 - v*v); break;
+            case ATAN:   r = atan(v);  dr = 1 / (1 + v*v);     break;
+            case EXP:    r = exp(v);   dr = r;                 break;
+            case LOG:    r = log(v);   dr = 1 / v;             break;
+            case LOG10:  r = log10(v); dr = 1 / (v * C::ln10); break;
+            case SQRT:   r = sqrt(v);  dr = 0.5 / r;           break;
+            case SINH:   r = sinh(v);  dr = cosh(v);           break;
+            case COSH:   r = cosh(v);  dr = sinh(v);           break;
+            case TANH:   r = tanh(v);  dr = 1 - r*r;           break;
+            case ABS:    r = fabs(v);  dr = (v < 0 ? -1 : 1);  break;
+            case FLOOR:  r = floor(v); dr = 0;                 break;
+            case CEIL:   r = ceil(v);  dr = 0;                 break;
+            case SQUARE: r = v*v;      dr = 2*v;               break;
+            default:     r = v*v*v;    dr = 3*v*v;             break;
+            }
+            a[j]   = r;
+            tmp[j] = dr;
+          }
+          if (instr.dep) {
+            for (uInt d=1; d<width; ++d) {
+              for (size_t j=0; j<n; ++j) {
+                a[d*BLOCK + j] *= tmp[j];
+              }
+            }
+          }
+        }
+        break;
+      default:
+        {
+          // A binary operator or function; the result replaces a.
+          Double* a = stack + (nstack-2)*entry;
+          Double* b = a + entry;
+          --nstack;
+          Op op = instr.op;
+          Int func = instr.arg;
+          if (op == FUNC2  &&  func == FPOW) {
+            op = POW;
+          }
+          const Bool aDep = instr.aDep;
+          const Bool bDep = instr.bDep;
+          // Do the derivatives first, because they need the values.
+          // Only the terms of operands depending on the parameters are used.
+          for (uInt d=1; d<width; ++d) {
+            Double* ad = a + d*BLOCK;
+            const Double* bd = b + d*BLOCK;
+            if (!instr.dep) {
+              std::fill (ad, ad + n, 0.);
+              continue;
+            }
+            for (size_t j=0; j<n; ++j) {
+              const Double av = a[j];
+              const Double bv = b[j];
+              Double da = (aDep ? ad[j] : 0);
+              Double db = (bDep ? bd[j] : 0);
+              switch (op) {
+              case ADD: ad[j] = da + db;                         break;
+              case SUB: ad[j] = da - db;                         break;
+              case MUL:
+                ad[j] = (aDep ? da*bv : 0) + (bDep ? av*db : 0);
+                break;
+              case DIV:
+                ad[j] = (aDep ? da/bv : 0) - (bDep ? av*db/(bv*bv) : 0);
+                break;
+              case POW:
+                ad[j] = (aDep ? bv * pow(av, bv-1) * da : 0) +
+                        (bDep ? pow(av, bv) * log(av) * db : 0);
+                break;
+              case FUNC2:
+                switch (func) {
+                case ATAN2:
+                  ad[j] = ((aDep ? bv*da : 0) - (bDep ? av*db : 0)) /
+                          (av*av + bv*bv);
+                  break;
+                case FMOD:
+                  ad[j] = da - (bDep ? trunc(av/bv) * db : 0);
+                  break;
+                case MIN:
+                  ad[j] = (av <= bv  ?  da : db);
+                  break;
+                default:
+                  ad[j] = (av >= bv  ?  da : db);
+                  break;
+                }
+                break;
+              default:
+                // Comparisons and logical operators do not depend on
+                // the parameters.
+                ad[j] = 0;
+                break;
+              }
+            }
+          }
+          for (size_t j=0; j<n; ++j) {
+            const Double av = a[j];
+            const Double bv = b[j];
+            Double r;
+            switch (op) {
+            case ADD: r = av + bv;            break;
+            case SUB: r = av - bv;            break;
+            case MUL: r = av * bv;            break;
+            case DIV: r = av / bv;            break;
+            case POW: r = pow(av, bv);        break;
+            case EQ:  r = (av == bv);         break;
+            case NE:  r = (av != bv);         break;
+            case LT:  r = (av < bv);          break;
+            case LE:  r = (av <= bv);         break;
+            case GT:  r = (av > bv);          break;
+            case GE:  r = (av >= bv);         break;
+            case AND: r = (av != 0  &&  bv != 0); break;
+            case OR:  r = (av != 0  ||  bv != 0); break;
+            default:
+              switch (func) {
+              case ATAN2: r = atan2(av, bv);           break;
+              case FMOD:  r = fmod(av, bv);            break;
+              case MIN:   r = (av <= bv  ?  av : bv);  break;
+              default:    r = (av >= bv  ?  av : bv);  break;
+              }
+              break;
+            }
+            a[j] = r;
+          }
+        }
+        break;
+      }
+    }
+    for (uInt d=0; d<width; ++d) {
+      for (size_t j=0; j<n; ++j) {
+        out[j*width + d] = stack[d*BLOCK + j];
+      }
+    }
+  }
+
+  boost::python::object ExprKernel::eval (PyObject* xobj,
+                                          const Vector<Double>& params,
+                                          uInt nthreads, Bool withDeriv) const
+  {
+    if (params.size() != itsNpar) {
+      throw AipsError ("ExprKernel: expected " + String::toString(itsNpar) +
+                       " parameters");
+    }
+    BorrowedArray<Double> xarr (xobj);
+    const Array<Double>& x = xarr.array();
+    uInt ndim = std::max (itsNdim, 1u);
+    if (x.size() % ndim != 0) {
+      throw AipsError ("ExprKernel: the number of values is not a multiple "
+                       "of ndim");
+    }
+    size_t npts = x.size() / ndim;
+    uInt width = (withDeriv ? itsNpar+1 : 1);
+    IPosition shape (1, npts);
+    if (withDeriv) {
+      // IPosition is in Fortran order, so numpy gets [npts,width].
+      shape = IPosition (2, width, npts);
+    }
+    Array<Double> result (shape);
+    Bool deleteX, deleteRes;
+    const Double* xPtr = x.getStorage (deleteX);
+    Double* resPtr = result.getStorage (deleteRes);
+    Vector<Double> pars (params.copy());
+    const Double* parPtr = pars.data();
+    uInt xstep = (itsNdim == 0 ? 0 : itsNdim);
+    {
+      ReleaseGIL release;
+      nthreads = nrThreads (nthreads, npts / 65536);
+      if (nthreads < 1) {
+        nthreads = 1;
+      }
+      size_t stackSize = std::max (itsMaxDepth, 1) * width * BLOCK;
+      runParts (npts, nthreads, [&] (uInt, size_t st, size_t end) {
+        std::vector<Double> stack (stackSize);
+        std::vector<Double> tmp (BLOCK);
+        for (size_t i=st; i<end; i+=BLOCK) {
+          size_t n = std::min (size_t(BLOCK), end-i);
+          evalBlock (xPtr + i*xstep, parPtr, n, width,
+                     &stack[0], &tmp[0], resPtr + i*width);
+        }
+      });
+    }
+    x.freeStorage (xPtr, deleteX);
+    result.putStorage (resPtr, deleteRes);
+    return arrayToPython (result);
+  }
+
+
+  void functionalexpr()
+  {
+    class_<ExprKernel> ("_exprkernel", init<String>())
+      .def ("ndim", &ExprKernel::ndim)
+      .def ("npar", &ExprKernel::npar)
+      .def ("_f", &ExprKernel::f)
+      .def ("_fdf", &ExprKernel::fdf)
+      ;
+  }
+
+} }
@@ -33,12 +33,16 @@
 #include <casacore/python/Converters/PycBasicData.h>
 #include <casacore/python/Converters/PycArray.h>
 #include <casacore/python/Converters/PycRecord.h>
+#include <casacore/python/Converters/PycValueHolder.h>
 
 BOOST_PYTHON_MODULE(_functionals)
 {
   casa::python::register_convert_excp();
   casa::python::register_convert_basicdata();
   casa::python::register_convert_casa_record();
+  casa::python::register_convert_casa_valueholder();
 
   casa::python::functional();
+  casa::python::functionaleval();
+  casa::python::functionalexpr();
 }
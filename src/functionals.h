@@ -33,6 +33,8 @@
 namespace casacore {
   namespace python {
     void functional();
+    void functionaleval();
+    void functionalexpr();
   } // python
 } //casa
 
@@ -0,0 +1,433 @@
+//# pybuffer.h: share array data between casacore and numpy without copying
+//# Copyright (C) 2017
+//# Associated Universities, Inc. Washington DC, USA.
+//#
+//# This library is free software; you can redistribute it and/or modify it
+//# under the terms of the GNU Library General Public License as published by
+//# the Free Software Foundation; either version 2 of the License, or (at your
+//# option) any later version.
+//#
+//# This library is distributed in the hope that it will be useful, but WITHOUT
+//# ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//# FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+//# License for more details.
+//#
+//# You should have received a copy of the GNU Library General Public License
+//# along with this library; if not, write to the Free Software Foundation,
+//# Inc., 675 Massachusetts Ave, Cambridge, MA 02139, USA.
+//#
+//# Correspondence concerning AIPS++ should be addressed as follows:
+//#        Internet email: aips2-request@nrao.edu.
+//#        Postal address: AIPS++ Project Office
+//#                        National Radio Astronomy Observatory
+//#                        520 Edgemont Road
+//#                        Charlottesville, VA 22903-2475 USA
+//#
+//# $Id: $
+
+#ifndef PYRAP_PYBUFFER_H
+#define PYRAP_PYBUFFER_H
+
+// The converters registered by casacore's python library copy the data
+// when converting between a numpy array and a casacore Array. The classes
+// and functions below use the Python buffer protocol (PEP 3118) instead:
+// <ul>
+//  <li> BorrowedArray makes a casacore Array using the memory of a
+//       C-contiguous and aligned numpy array (or other buffer) if its data
+//       type matches; otherwise the normal (copying) conversion is used.
+//  <li> arrayToPython takes over a casacore Array and hands its storage
+//       to numpy. The Array is kept alive by a small Python object
+//       exporting it as a buffer, which becomes the base of the numpy array.
+//       The caller's Array is emptied, so it cannot alias the numpy array.
+//       If the storage is still used by another object (e.g. the pixels of
+//       an in-memory image or a record field), ownership cannot be taken
+//       and numpy gets a copy.
+// </ul>
+// The number of bytes that still had to be copied is counted, so tests can
+// check that the zero-copy paths are taken. The counter is atomic, because
+// the converters can be used by threads not holding the GIL.
+
+#include <Python.h>
+
+#include <casacore/casa/Arrays/Array.h>
+#include <casacore/casa/Containers/ValueHolder.h>
+#include <casacore/casa/BasicSL/Complex.h>
+#include <casacore/casa/Utilities/DataType.h>
+#include <casacore/casa/Exceptions/Error.h>
+#include <casacore/python/Converters/PycValueHolder.h>
+
+#include <boost/python.hpp>
+
+#include <atomic>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace casacore {
+  namespace python {
+
+    // The number of bytes copied by the buffer converters.
+    inline std::atomic<Int64>& pyBufferBytesCopied()
+    {
+      static std::atomic<Int64> nbytes (0);
+      return nbytes;
+    }
+
+    // The kind ('b'ool, 'i'nt, 'u'nsigned, 'f'loat, 'c'omplex) and
+    // buffer format of the supported data types.
+    template<typename T> struct PyBufferType;
+    template<> struct PyBufferType<Bool>
+      { static char kind() {return 'b';} static const char* format() {return "?";} };
+    template<> struct PyBufferType<uChar>
+      { static char kind() {return 'u';} static const char* format() {return "B";} };
+    template<> struct PyBufferType<Short>
+      { static char kind() {return 'i';} static const char* format() {return "h";} };
+    template<> struct PyBufferType<uShort>
+      { static char kind() {return 'u';} static const char* format() {return "H";} };
+    template<> struct PyBufferType<Int>
+      { static char kind() {return 'i';} static const char* format() {return "i";} };
+    template<> struct PyBufferType<uInt>
+      { static char kind() {return 'u';} static const char* format() {return "I";} };
+    template<> struct PyBufferType<Int64>
+      { static char kind() {return 'i';} static const char* format() {return "q";} };
+    template<> struct PyBufferType<Float>
+      { static char kind() {return 'f';} static const char* format() {return "f";} };
+    template<> struct PyBufferType<Double>
+      { static char kind() {return 'f';} static const char* format() {return "d";} };
+    template<> struct PyBufferType<Complex>
+      { static char kind() {return 'c';} static const char* format() {return "Zf";} };
+    template<> struct PyBufferType<DComplex>
+      { static char kind() {return 'c';} static const char* format() {return "Zd";} };
+
+    // Get the kind of a buffer format string (0 if unknown or not native).
+    inline char pyBufferKind (const char* format)
+    {
+      if (format == 0) {
+        return 'u';                  // plain bytes
+      }
+      // Skip native byte order and alignment characters.
+      while (*format == '@'  ||  *format == '='  ||
+#if defined(AIPS_LITTLE_ENDIAN)
+             *format == '<'  ||
+#else
+             *format == '>'  ||  *format == '!'  ||
+#endif
+             false) {
+        ++format;
+      }
+      if (format[0] == 'Z') {
+        return (format[1] == 'f'  ||  format[1] == 'd') && format[2] == 0
+          ? 'c' : 0;
+      }
+      if (format[0] == 0  ||  format[1] != 0) {
+        return 0;
+      }
+      switch (format[0]) {
+      case '?':
+        return 'b';
+      case 'b': case 'h': case 'i': case 'l': case 'q': case 'n':
+        return 'i';
+      case 'B': case 'H': case 'I': case 'L': case 'Q': case 'N':
+        return 'u';
+      case 'f': case 'd':
+        return 'f';
+      default:
+        return 0;
+      }
+    }
+
+    // Get a casacore Array from a ValueHolder (the copying conversion).
+    inline void fromValueHolder (const ValueHolder& vh, Array<Bool>& arr)
+      { arr.reference (vh.asArrayBool()); }
+    inline void fromValueHolder (const ValueHolder& vh, Array<uChar>& arr)
+      { arr.reference (vh.asArrayuChar()); }
+    inline void fromValueHolder (const ValueHolder& vh, Array<Short>& arr)
+      { arr.reference (vh.asArrayShort()); }
+    inline void fromValueHolder (const ValueHolder& vh, Array<Int>& arr)
+      { arr.reference (vh.asArrayInt()); }
+    inline void fromValueHolder (const ValueHolder& vh, Array<uInt>& arr)
+      { arr.reference (vh.asArrayuInt()); }
+    inline void fromValueHolder (const ValueHolder& vh, Array<Int64>& arr)
+      { arr.reference (vh.asArrayInt64()); }
+    inline void fromValueHolder (const ValueHolder& vh, Array<Float>& arr)
+      { arr.reference (vh.asArrayFloat()); }
+    inline void fromValueHolder (const ValueHolder& vh, Array<Double>& arr)
+      { arr.reference (vh.asArrayDouble()); }
+    inline void fromValueHolder (const ValueHolder& vh, Array<Complex>& arr)
+      { arr.reference (vh.asArrayComplex()); }
+    inline void fromValueHolder (const ValueHolder& vh, Array<DComplex>& arr)
+      { arr.reference (vh.asArrayDComplex()); }
+
+
+    // Tell if a Python object is an array (with at least one axis) whose
+    // buffer can be borrowed. Scalars, bytes and strings are values for the
+    // normal conversion.
+    inline Bool pyBufferIsArray (PyObject* obj)
+    {
+      if (!PyObject_CheckBuffer(obj)  ||  PyBytes_Check(obj)  ||
+          PyByteArray_Check(obj)  ||  !PyObject_HasAttrString(obj, "ndim")) {
+        return False;
+      }
+      boost::python::object arr
+        (boost::python::handle<>(boost::python::borrowed(obj)));
+      return boost::python::extract<int>(arr.attr("ndim"))() > 0;
+    }
+
+    // Get a ValueHolder from a Python object (the copying conversion).
+    inline ValueHolder pyToValueHolder (PyObject* obj)
+    {
+      return boost::python::extract<ValueHolder>(boost::python::object
+        (boost::python::handle<>(boost::python::borrowed(obj))));
+    }
+
+    // A casacore Array of type T using the memory of a Python object if
+    // possible. The object's buffer is held (and the object kept alive)
+    // as long as the BorrowedArray exists; the GIL is not needed to use
+    // the array.
+    template<typename T>
+    class BorrowedArray
+    {
+    public:
+      explicit BorrowedArray (PyObject* obj)
+        : itsHasView (False)
+      {
+        if (PyObject_CheckBuffer(obj)  &&
+            PyObject_GetBuffer (obj, &itsView,
+                                PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) == 0) {
+          itsHasView = True;
+          if (pyBufferKind(itsView.format) == PyBufferType<T>::kind()  &&
+              itsView.itemsize == Py_ssize_t(sizeof(T))  &&
+              size_t(itsView.buf) % sizeof(T) == 0) {
+            // numpy's C order is casacore's Fortran order reversed.
+            IPosition shape (1, 1);
+            if (itsView.ndim > 0) {
+              shape.resize (itsView.ndim);
+              for (int i=0; i<itsView.ndim; ++i) {
+                shape[i] = itsView.shape[itsView.ndim - i - 1];
+              }
+            }
+            itsArray.takeStorage (shape, static_cast<T*>(itsView.buf),
+                                  SHARE);
+            return;
+          }
+          PyBuffer_Release (&itsView);
+          itsHasView = False;
+        }
+        PyErr_Clear();
+        // Use the normal conversion.
+        ValueHolder vh = pyToValueHolder (obj);
+        fromValueHolder (vh, itsArray);
+        pyBufferBytesCopied() += itsArray.size() * sizeof(T);
+      }
+
+      ~BorrowedArray()
+      {
+        // Make sure the array does not refer to the buffer anymore.
+        itsArray.resize();
+        if (itsHasView) {
+          PyBuffer_Release (&itsView);
+        }
+      }
+
+      // Tell if the memory of the Python object is used.
+      Bool borrowed() const
+        { return itsHasView; }
+
+      const Array<T>& array() const
+        { return itsArray; }
+
+    private:
+      BorrowedArray (const BorrowedArray&);
+      BorrowedArray& operator= (const BorrowedArray&);
+
+      Py_buffer itsView;
+      Bool      itsHasView;
+      Array<T>  itsArray;
+    };
+
+
+    // Base class of the object holding an Array exported as a buffer.
+    class PyArrayBufferHolder
+    {
+    public:
+      virtual ~PyArrayBufferHolder()
+        {}
+      void*                   itsData;
+      const char*             itsFormat;
+      Py_ssize_t              itsItemSize;
+      Py_ssize_t              itsLength;
+      std::vector<Py_ssize_t> itsShape;
+      std::vector<Py_ssize_t> itsStrides;
+    };
+
+    template<typename T>
+    class PyArrayBufferHolderT : public PyArrayBufferHolder
+    {
+    public:
+      // Take over the given Array, which is emptied. Its storage is only
+      // kept if no other object refers to it anymore; otherwise writing
+      // into the numpy array would change that object, so it is copied.
+      explicit PyArrayBufferHolderT (Array<T>& arr)
+      {
+        itsArray.reference (arr);
+        arr.resize();
+        if (itsArray.nrefs() != 1  ||  !itsArray.contiguousStorage()) {
+          Array<T> tmp (itsArray.copy());
+          itsArray.reference (tmp);
+          pyBufferBytesCopied() += itsArray.size() * sizeof(T);
+        }
+        Bool deleteIt;
+        itsData     = const_cast<T*>(itsArray.getStorage (deleteIt));
+        itsFormat   = PyBufferType<T>::format();
+        itsItemSize = sizeof(T);
+        itsLength   = itsArray.size() * sizeof(T);
+        // numpy's C order is casacore's Fortran order reversed.
+        const IPosition& shape = itsArray.shape();
+        int ndim = shape.size();
+        itsShape.resize (ndim);
+        itsStrides.resize (ndim);
+        Py_ssize_t stride = sizeof(T);
+        for (int i=0; i<ndim; ++i) {
+          itsShape[ndim-i-1]   = shape[i];
+          itsStrides[ndim-i-1] = stride;
+          stride *= shape[i];
+        }
+      }
+    private:
+      Array<T> itsArray;
+    };
+
+    // The Python object exporting the buffer.
+    struct PyArrayBufferObject
+    {
+      PyObject_HEAD
+      PyArrayBufferHolder* holder;
+    };
+
+    inline int pyArrayBufferGet (PyObject* self, Py_buffer* view, int flags)
+    {
+      PyArrayBufferHolder* holder =
+        reinterpret_cast<PyArrayBufferObject*>(self)->holder;
+      view->obj        = self;
+      Py_INCREF (self);
+      view->buf        = holder->itsData;
+      view->len        = holder->itsLength;
+      view->readonly   = 0;
+      view->itemsize   = holder->itsItemSize;
+      view->format     = (flags & PyBUF_FORMAT) ?
+                           const_cast<char*>(holder->itsFormat) : 0;
+      view->ndim       = holder->itsShape.size();
+      view->shape      = &(holder->itsShape[0]);
+      view->strides    = &(holder->itsStrides[0]);
+      view->suboffsets = 0;
+      view->internal   = 0;
+      return 0;
+    }
+
+    inline void pyArrayBufferDealloc (PyObject* self)
+    {
+      delete reinterpret_cast<PyArrayBufferObject*>(self)->holder;
+      Py_TYPE(self)->tp_free (self);
+    }
+
+    inline PyTypeObject* pyArrayBufferType()
+    {
+      static PyTypeObject type = {PyVarObject_HEAD_INIT(0, 0)};
+      static PyBufferProcs procs;
+      if (type.tp_name == 0) {
+        procs.bf_getbuffer = pyArrayBufferGet;
+        type.tp_name       = "casacore.arraybuffer";
+        type.tp_basicsize  = sizeof(PyArrayBufferObject);
+        type.tp_dealloc    = pyArrayBufferDealloc;
+        type.tp_as_buffer  = &procs;
+#if PY_MAJOR_VERSION < 3
+        type.tp_flags      = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_NEWBUFFER;
+#else
+        type.tp_flags      = Py_TPFLAGS_DEFAULT;
+#endif
+        if (PyType_Ready (&type) < 0) {
+          boost::python::throw_error_already_set();
+        }
+      }
+      return &type;
+    }
+
+    // Turn a casacore Array into a numpy array. The Array is taken over
+    // (it is empty on return); its storage is shared with numpy if nothing
+    // else refers to it, otherwise numpy gets a copy.
+    template<typename T>
+    boost::python::object arrayToPython (Array<T>& arr)
+    {
+      PyArrayBufferObject* obj =
+        PyObject_New (PyArrayBufferObject, pyArrayBufferType());
+      if (obj == 0) {
+        boost::python::throw_error_already_set();
+      }
+      obj->holder = 0;
+      boost::python::object buffer
+        (boost::python::handle<>(reinterpret_cast<PyObject*>(obj)));
+      obj->holder = new PyArrayBufferHolderT<T> (arr);
+      // Look up numpy.asarray once; it is kept until the interpreter exits.
+      static PyObject* asarray = 0;
+      if (asarray == 0) {
+        asarray = boost::python::incref
+          (boost::python::import("numpy").attr("asarray").ptr());
+      }
+      return boost::python::call<boost::python::object> (asarray, buffer);
+    }
+
+    // Take the Array out of a ValueHolder and turn it into a numpy array.
+    // The ValueHolder is emptied; empty arrays use the normal conversion.
+    template<typename T>
+    boost::python::object takeValueHolderArray (ValueHolder& vh)
+    {
+      Array<T> arr;
+      fromValueHolder (vh, arr);
+      if (arr.size() == 0) {
+        return boost::python::object (vh);
+      }
+      vh = ValueHolder();
+      return arrayToPython (arr);
+    }
+
+    // Convert a ValueHolder to Python. The ValueHolder is taken over: a
+    // numeric array in it is handed to numpy (see arrayToPython) and the
+    // ValueHolder is emptied. Other values use the normal conversion.
+    // Callers not owning the value should pass a copy of the ValueHolder;
+    // its storage is then still shared, so numpy gets a copy of the data.
+    inline boost::python::object valueHolderToPython (ValueHolder& vh)
+    {
+      if (!vh.isNull()  &&  vh.dataType() != TpArrayString  &&
+          isArray(vh.dataType())) {
+        switch (vh.dataType()) {
+        case TpArrayBool:
+          return takeValueHolderArray<Bool> (vh);
+        case TpArrayUChar:
+          return takeValueHolderArray<uChar> (vh);
+        case TpArrayShort:
+          return takeValueHolderArray<Short> (vh);
+        case TpArrayInt:
+          return takeValueHolderArray<Int> (vh);
+        case TpArrayUInt:
+          return takeValueHolderArray<uInt> (vh);
+        case TpArrayInt64:
+          return takeValueHolderArray<Int64> (vh);
+        case TpArrayFloat:
+          return takeValueHolderArray<Float> (vh);
+        case TpArrayDouble:
+          return takeValueHolderArray<Double> (vh);
+        case TpArrayComplex:
+          return takeValueHolderArray<Complex> (vh);
+        case TpArrayDComplex:
+          return takeValueHolderArray<DComplex> (vh);
+        default:
+          break;
+        }
+      }
+      return boost::python::object (vh);
+    }
+
+  } // python
+} //casa
+
+#endif
@@ -0,0 +1,58 @@
+//# pygil.h: release the Python GIL during long running casacore operations
+//# Copyright (C) 2017
+//# Associated Universities, Inc. Washington DC, USA.
+//#
+//# This library is free software; you can redistribute it and/or modify it
+//# under the terms of the GNU Library General Public License as published by
+//# the Free Software Foundation; either version 2 of the License, or (at your
+//# option) any later version.
+//#
+//# This library is distributed in the hope that it will be useful, but WITHOUT
+//# ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//# FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+//# License for more details.
+//#
+//# You should have received a copy of the GNU Library General Public License
+//# along with this library; if not, write to the Free Software Foundation,
+//# Inc., 675 Massachusetts Ave, Cambridge, MA 02139, USA.
+//#
+//# Correspondence concerning AIPS++ should be addressed as follows:
+//#        Internet email: aips2-request@nrao.edu.
+//#        Postal address: AIPS++ Project Office
+//#                        National Radio Astronomy Observatory
+//#                        520 Edgemont Road
+//#                        Charlottesville, VA 22903-2475 USA
+//#
+//# $Id: $
+
+#ifndef PYRAP_PYGIL_H
+#define PYRAP_PYGIL_H
+
+#include <Python.h>
+
+namespace casacore {
+  namespace python {
+
+    // Release the GIL for the lifetime of the object, so other Python
+    // threads can run while casacore does a long operation.
+    // No Python objects may be touched while the GIL is released.
+    // The GIL is also reacquired if an exception is thrown.
+    class ReleaseGIL
+    {
+    public:
+      ReleaseGIL()
+        : itsState (PyEval_SaveThread())
+      {}
+      ~ReleaseGIL()
+        { PyEval_RestoreThread (itsState); }
+    private:
+      ReleaseGIL (const ReleaseGIL&);
+      ReleaseGIL& operator= (const ReleaseGIL&);
+
+      PyThreadState* itsState;
+    };
+
+  } // python
+} //casa
+
+#endif
@@ -25,19 +25,533 @@
 //#
 //# $Id$
 
+#include "pygil.h"
+#include "pybuffer.h"
+#include "pythreads.h"
+
 #include <casacore/images/Images/ImageProxy.h>
+#include <casacore/images/Images/ImageFITSConverter.h>
+#include <casacore/images/Images/PagedImage.h>
+#include <casacore/images/Images/ImageUtilities.h>
+#include <casacore/images/Images/ImageExpr.h>
+#include <casacore/lattices/LEL/LatticeExpr.h>
+#include <casacore/lattices/LEL/LatticeExprNode.h>
+#include <casacore/lattices/Lattices/LatticeUtilities.h>
+#include <casacore/lattices/Lattices/LatticeIterator.h>
+#include <casacore/casa/BasicMath/Math.h>
+#include <casacore/casa/OS/CanonicalConversion.h>
+#include <casacore/casa/OS/File.h>
+#include <casacore/fits/FITS/fits.h>
+#include <casacore/tables/Tables/TableDesc.h>
+#include <casacore/tables/Tables/ArrColDesc.h>
+#include <casacore/tables/Tables/SetupNewTab.h>
+#include <casacore/tables/DataMan/TiledShapeStMan.h>
+#include <casacore/tables/DataMan/CompressFloat.h>
+#include <casacore/tables/DataMan/CompressComplex.h>
+#include <casacore/casa/Logging/LogIO.h>
+#include <casacore/casa/Exceptions/Error.h>
 #include <casacore/python/Converters/PycBasicData.h>
 #include <casacore/python/Converters/PycValueHolder.h>
 #include <casacore/python/Converters/PycRecord.h>
 #include <boost/python.hpp>
 #include <boost/python/args.hpp>
 
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
 using namespace boost::python;
 
 namespace casacore { namespace python {
 
+  // Derive the scale and offset to map the data range onto the 16-bit
+  // integers used by CompressFloat and CompressComplex.
+  // The value -32768 is reserved for undefined values.
+  void compressScale (Double minVal, Double maxVal,
+                      Double& scale, Double& offset)
+  {
+    offset = (maxVal + minVal) / 2;
+    scale  = (maxVal - minVal) / 65534;
+    if (scale <= 0) {
+      scale = 1;
+    }
+  }
+
+  // Write an image as a PagedImage of which the pixels are stored as
+  // scaled integers in a TiledShapeStMan column. The "map" column is a
+  // virtual column (ENGINE) on top of it, so PagedImage reads and writes
+  // it as usual and tiles can still be accessed randomly.
+  template<typename T, typename STORED, typename ENGINE>
+  void saveCompressed (const ImageInterface<T>& image,
+                       const String& fileName, Bool overwrite,
+                       Bool copyMask, const String& newMaskName,
+                       const IPosition& newTileShape,
+                       Double scale, Double offset)
+  {
+    TiledShape tiledShape (newTileShape.empty()  ?
+                           TiledShape (image.shape()) :
+                           TiledShape (image.shape(), newTileShape));
+    TableDesc td;
+    td.addColumn (ArrayColumnDesc<T> ("map"));
+    td.addColumn (ArrayColumnDesc<STORED> ("map_Comp"));
+    SetupNewTable newtab (fileName, td,
+                          overwrite ? Table::New : Table::NewNoReplace);
+    ENGINE engine ("map", "map_Comp", scale, offset);
+    TiledShapeStMan stman ("TiledShapeStMan_Comp", tiledShape.tileShape());
+    newtab.bindColumn ("map", engine);
+    newtab.bindColumn ("map_Comp", stman);
+    Table tab (newtab);
+    PagedImage<T> out (tiledShape, image.coordinates(), tab);
+    ImageUtilities::copyMiscellaneous (out, image);
+    if (copyMask  &&  image.isMasked()) {
+      String maskName (newMaskName);
+      if (maskName.empty()) {
+        maskName = image.getDefaultMask();
+        if (maskName.empty()) {
+          maskName = "mask0";
+        }
+      }
+      out.makeMask (maskName, True, True);
+      LogIO os;
+      LatticeUtilities::copyDataAndMask (os, out, image);
+    } else {
+      out.copyData (image);
+    }
+  }
+
+  // Update the range with a value if it is finite.
+  inline void updateRange (Double value, Double& minVal, Double& maxVal)
+  {
+    if (isFinite(value)) {
+      minVal = std::min (minVal, value);
+      maxVal = std::max (maxVal, value);
+    }
+  }
+  inline void updateRange (Float value, Double& minVal, Double& maxVal)
+    { updateRange (Double(value), minVal, maxVal); }
+  inline void updateRange (const Complex& value,
+                           Double& minVal, Double& maxVal)
+  {
+    // Real and imaginary parts share the scale and offset.
+    updateRange (Double(value.real()), minVal, maxVal);
+    updateRange (Double(value.imag()), minVal, maxVal);
+  }
+
+  // Get the range of all finite pixels, ignoring the mask (masked pixels
+  // are also stored, so they must not be clipped).
+  // If there are no finite pixels, the range is [0,0].
+  template<typename T>
+  void finiteRange (const ImageInterface<T>& image,
+                    Double& minVal, Double& maxVal)
+  {
+    minVal = std::numeric_limits<Double>::max();
+    maxVal = -minVal;
+    RO_LatticeIterator<T> iter (image);
+    for (iter.reset(); !iter.atEnd(); iter++) {
+      const Array<T>& cursor = iter.cursor();
+      for (typename Array<T>::const_iterator it=cursor.begin();
+           it!=cursor.end(); ++it) {
+        updateRange (*it, minVal, maxVal);
+      }
+    }
+    if (minVal > maxVal) {
+      minVal = maxVal = 0;
+    }
+  }
+
+  // Save the image with its pixels compressed.
+  // Only the 'scaled' codec (16-bit scaled integers) is supported and
+  // only for float and complex images.
+  void saveAsCompressed (ImageProxy& self, const String& fileName,
+                         Bool overwrite, Bool copyMask,
+                         const String& newMaskName,
+                         const IPosition& newTileShape,
+                         const String& codec)
+  {
+    if (codec != "scaled") {
+      throw AipsError ("Unknown image compression codec " + codec +
+                       "; only 'scaled' is supported");
+    }
+    const LatticeBase* lattice = self.getLattice();
+    Double scale, offset;
+    if (lattice->dataType() == TpFloat) {
+      const ImageInterface<Float>& image =
+        dynamic_cast<const ImageInterface<Float>&>(*lattice);
+      Double minVal, maxVal;
+      finiteRange (image, minVal, maxVal);
+      compressScale (minVal, maxVal, scale, offset);
+      saveCompressed<Float,Short,CompressFloat>
+        (image, fileName, overwrite, copyMask, newMaskName, newTileShape,
+         scale, offset);
+    } else if (lattice->dataType() == TpComplex) {
+      const ImageInterface<Complex>& image =
+        dynamic_cast<const ImageInterface<Complex>&>(*lattice);
+      Double minVal, maxVal;
+      finiteRange (image, minVal, maxVal);
+      compressScale (minVal, maxVal, scale, offset);
+      saveCompressed<Complex,Int,CompressComplex>
+        (image, fileName, overwrite, copyMask, newMaskName, newTileShape,
+         scale, offset);
+    } else {
+      throw AipsError ("Compressed images can only be made for float "
+                       "or complex images");
+    }
+  }
+
+  // Convert n pixels of a chunk to big-endian FITS values.
+  // Masked pixels are written as NaN (BITPIX=-32) or the BLANK value
+  // (BITPIX=16), just like ImageFITSConverter does.
+  void toFitsPixels (const Float* data, const Bool* mask, size_t n,
+                     Int bitpix, Double bscale, Double bzero, Short blank,
+                     char* out)
+  {
+    const size_t nbuf = 4096;
+    if (bitpix == -32) {
+      Float buf[nbuf];
+      for (size_t i=0; i<n; i+=nbuf) {
+        size_t m = std::min (nbuf, n-i);
+        for (size_t j=0; j<m; ++j) {
+          buf[j] = (mask  &&  !mask[i+j]) ?
+            std::numeric_limits<Float>::quiet_NaN() : data[i+j];
+        }
+        CanonicalConversion::fromLocal (out + i*sizeof(Float), buf, m);
+      }
+    } else {
+      Short buf[nbuf];
+      for (size_t i=0; i<n; i+=nbuf) {
+        size_t m = std::min (nbuf, n-i);
+        for (size_t j=0; j<m; ++j) {
+          Double v = (data[i+j] - bzero) / bscale;
+          if ((mask  &&  !mask[i+j])  ||  !isFinite(v)) {
+            buf[j] = blank;
+          } else {
+            buf[j] = Short (std::floor (std::min (32767., std::max (-32767., v))
+                                        + 0.5));
+          }
+        }
+        CanonicalConversion::fromLocal (out + i*sizeof(Short), buf, m);
+      }
+    }
+  }
+
+  // Get the shape of the chunks in which an image is exported to FITS.
+  // A chunk has at most maxPixels pixels (but at least one line) and
+  // spans all lower axes, so each chunk is a contiguous block of FITS
+  // rows. The chunks are stepped through in storage (i.e. FITS) order.
+  IPosition fitsChunkShape (const IPosition& shape, size_t maxPixels)
+  {
+    IPosition chunkShape (shape.size(), 1);
+    size_t lowerPixels = 1;
+    uInt k = 0;
+    while (k < shape.size()  &&  lowerPixels * shape[k] <= maxPixels) {
+      chunkShape[k] = shape[k];
+      lowerPixels *= shape[k];
+      ++k;
+    }
+    if (k < shape.size()) {
+      chunkShape[k] = std::max (size_t(1), maxPixels / lowerPixels);
+    }
+    return chunkShape;
+  }
+
+  // A chunk of converted FITS data waiting to be written.
+  typedef std::shared_ptr<std::vector<char> > FitsBlock;
+
+  // Write an image to FITS in chunks, where the conversion is done in
+  // parallel and the writing in a separate thread.
+  // The header is made by ImageFITSConverter, so it is the same as for
+  // toFits (without the history and the extra tables).
+  // Casacore images cannot be read by multiple threads, so the chunks are
+  // read one by one in the calling thread. They are read with the GIL held,
+  // so no other Python thread can use or close the image meanwhile.
+  // While the chunk is converted (by nthreads threads) and while waiting
+  // for the writer, the GIL is released. The writer thread writes the
+  // converted chunks (contiguous blocks of FITS rows) sequentially.
+  // The chunks, together with at most two chunks waiting to be written,
+  // take about memoryInMB. After each chunk progress(done, total) is called
+  // with the number of pixels read (unless progress is None).
+  // A double image is converted to float on the fly (as FITS export
+  // only handles float images).
+  void toFitsChunked (ImageProxy& self, const String& fileName,
+                      Bool overwrite, Bool velocity, Bool optical,
+                      Int bitpix, Double minpix, Double maxpix,
+                      uInt memoryInMB, Int nthreads,
+                      const boost::python::object& progress)
+  {
+    if (bitpix != -32  &&  bitpix != 16) {
+      throw AipsError ("BITPIX must be -32 or 16 for FITS export");
+    }
+    LatticeBase* lattice = self.getLattice();
+    std::unique_ptr<ImageInterface<Float> > converted;
+    ImageInterface<Float>* image = 0;
+    if (lattice->dataType() == TpFloat) {
+      image = dynamic_cast<ImageInterface<Float>*>(lattice);
+    } else if (lattice->dataType() == TpDouble) {
+      ImageInterface<Double>& dimage =
+        dynamic_cast<ImageInterface<Double>&>(*lattice);
+      LatticeExprNode node (toFloat (LatticeExprNode (dimage)));
+      converted.reset (new ImageExpr<Float> (LatticeExpr<Float>(node),
+                                             "float(" + dimage.name() + ")"));
+      converted->setUnits (dimage.units());
+      converted->setImageInfo (dimage.imageInfo());
+      converted->setMiscInfo (dimage.miscInfo());
+      image = converted.get();
+    } else {
+      throw AipsError ("Only a float or double image can be written to FITS");
+    }
+    if (!overwrite  &&  File(fileName).exists()) {
+      throw AipsError ("FITS file " + fileName + " already exists");
+    }
+    // Make the header (it determines BSCALE and BZERO for BITPIX=16).
+    String error;
+    IPosition newTileShape;
+    FitsKeywordList kw;
+    if (! ImageFITSConverter::ImageHeaderToFITS (error, newTileShape, kw,
+                                                 *image, memoryInMB,
+                                                 velocity, optical, bitpix,
+                                                 minpix, maxpix,
+                                                 False, False)) {
+      throw AipsError (error);
+    }
+    Double bscale = 1;
+    Double bzero  = 0;
+    Short  blank  = -32768;
+    if (bitpix == 16) {
+      if (kw(FITS::BSCALE)) bscale = kw(FITS::BSCALE)->asDouble();
+      if (kw(FITS::BZERO))  bzero  = kw(FITS::BZERO)->asDouble();
+      if (kw(FITS::BLANK))  blank  = kw(FITS::BLANK)->asInt();
+    }
+    const size_t outSize = (bitpix == 16 ? sizeof(Short) : sizeof(Float));
+    const IPosition shape = image->shape();
+    const size_t npixel = shape.product();
+    const size_t maxPixels =
+      std::max (size_t(1), size_t(memoryInMB) * 1024 * 1024 /
+                (3 * (sizeof(Float) + sizeof(Bool) + outSize)));
+    const IPosition chunkShape = fitsChunkShape (shape, maxPixels);
+    const uInt nthr = nrThreads (std::max(nthreads, 0),
+                                 std::min (npixel, chunkShape.product()));
+    const Bool hasMask = image->isMasked();
+    std::FILE* file = std::fopen (fileName.c_str(), "wb");
+    if (file == 0) {
+      throw AipsError ("Could not create FITS file " + fileName);
+    }
+    // The writer thread.
+    std::deque<FitsBlock> queue;
+    std::mutex mutex;
+    std::condition_variable changed;
+    Bool writeDone = False;
+    Bool writeError = False;
+    std::thread writer ([&] () {
+      while (True) {
+        FitsBlock block;
+        {
+          std::unique_lock<std::mutex> lock(mutex);
+          changed.wait (lock, [&] () {return writeDone || !queue.empty();});
+          if (queue.empty()) {
+            break;
+          }
+          block = queue.front();
+        }
+        Bool ok = std::fwrite (&((*block)[0]), 1, block->size(), file)
+          == block->size();
+        std::lock_guard<std::mutex> lock(mutex);
+        queue.pop_front();
+        if (!ok) {
+          writeError = True;
+          queue.clear();
+        }
+        changed.notify_all();
+        if (!ok) {
+          break;
+        }
+      }
+    });
+    // Stop the writer thread; wait until all queued blocks are written.
+    auto stopWriter = [&] () {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        writeDone = True;
+        changed.notify_all();
+      }
+      writer.join();
+    };
+    try {
+      // Write the header.
+      FitsKeyCardTranslator translator;
+      FitsBlock header (new std::vector<char>());
+      char cards[2880];
+      kw.first();
+      while (True) {
+        Bool more = translator.build (cards, kw);
+        header->insert (header->end(), cards, cards+2880);
+        if (!more) {
+          break;
+        }
+      }
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        queue.push_back (header);
+        changed.notify_all();
+      }
+      // Read, convert and write the chunks.
+      IPosition blc (shape.size(), 0);
+      size_t ndone = 0;
+      while (ndone < npixel) {
+        IPosition chunk = chunkShape;
+        for (uInt i=0; i<shape.size(); ++i) {
+          chunk[i] = std::min (chunk[i], shape[i] - blc[i]);
+        }
+        Array<Float> data (image->getSlice (blc, chunk));
+        Array<Bool> mask;
+        if (hasMask) {
+          mask.reference (image->getMaskSlice (blc, chunk));
+        }
+        {
+          ReleaseGIL release;
+          const size_t n = data.size();
+          FitsBlock block (new std::vector<char>(n * outSize));
+          Bool deleteData, deleteMask;
+          const Float* dataPtr = data.getStorage (deleteData);
+          const Bool* maskPtr = (hasMask ? mask.getStorage (deleteMask) : 0);
+          char* out = &((*block)[0]);
+          runParts (n, nthr, [&] (uInt, size_t st, size_t end) {
+              toFitsPixels (dataPtr + st, (maskPtr ? maskPtr + st : 0),
+                            end - st, bitpix, bscale, bzero, blank,
+                            out + st*outSize);
+            });
+          data.freeStorage (dataPtr, deleteData);
+          if (hasMask) {
+            mask.freeStorage (maskPtr, deleteMask);
+          }
+          std::unique_lock<std::mutex> lock(mutex);
+          changed.wait (lock, [&] () {return writeError || queue.size() < 2;});
+          if (writeError) {
+            throw AipsError ("Could not write FITS file " + fileName);
+          }
+          queue.push_back (block);
+          changed.notify_all();
+          ndone += n;
+        }
+        if (!progress.is_none()) {
+          progress (ndone, npixel);
+        }
+        // Step to the next chunk (the lower axes are always full).
+        for (uInt i=0; i<shape.size(); ++i) {
+          blc[i] += chunkShape[i];
+          if (blc[i] < shape[i]) {
+            break;
+          }
+          blc[i] = 0;
+        }
+      }
+      // Pad the data to a multiple of 2880 bytes.
+      size_t nrem = (npixel * outSize) % 2880;
+      if (nrem > 0) {
+        FitsBlock pad (new std::vector<char>(2880 - nrem, 0));
+        std::lock_guard<std::mutex> lock(mutex);
+        queue.push_back (pad);
+        changed.notify_all();
+      }
+      {
+        ReleaseGIL release;
+        stopWriter();
+      }
+    } catch (...) {
+      if (writer.joinable()) {
+        ReleaseGIL release;
+        stopWriter();
+      }
+      std::fclose (file);
+      throw;
+    }
+    if (std::fclose (file) != 0  ||  writeError) {
+      throw AipsError ("Could not write FITS file " + fileName);
+    }
+  }
+
+  // Get the cursor shape fitting the tiles of the image. For a virtual
+  // (concatenated or sub) image it is derived from the underlying images.
+  IPosition niceCursorShape (ImageProxy& self)
+  {
+    return self.getLattice()->niceCursorShape();
+  }
+
+  // Get a data slice without holding the GIL, so a Python thread can
+  // prefetch the next chunk while the current one is being processed.
+  boost::python::object getDataNoGIL (ImageProxy& self,
+                                      const IPosition& blc,
+                                      const IPosition& trc,
+                                      const IPosition& inc)
+  {
+    ValueHolder data;
+    {
+      ReleaseGIL release;
+      data = self.getData (blc, trc, inc);
+    }
+    return valueHolderToPython (data);
+  }
+
+  // Get a data slice, handing it to numpy without copying it.
+  boost::python::object getDataNoCopy (ImageProxy& self,
+                                       const IPosition& blc,
+                                       const IPosition& trc,
+                                       const IPosition& inc)
+  {
+    ValueHolder data (self.getData (blc, trc, inc));
+    return valueHolderToPython (data);
+  }
+
+  template<typename T>
+  void putDataBorrowed (ImageProxy& self, PyObject* value,
+                        const IPosition& blc, const IPosition& inc)
+  {
+    BorrowedArray<T> arr (value);
+    self.putData (ValueHolder(arr.array()), blc, inc);
+  }
+
+  // Put a data slice, using the memory of a numpy array of the image's
+  // data type without copying it. Other values use the normal conversion.
+  void putDataNoCopy (ImageProxy& self, PyObject* value,
+                      const IPosition& blc, const IPosition& inc)
+  {
+    if (pyBufferIsArray (value)) {
+      switch (self.getLattice()->dataType()) {
+      case TpFloat:
+        putDataBorrowed<Float> (self, value, blc, inc);
+        return;
+      case TpDouble:
+        putDataBorrowed<Double> (self, value, blc, inc);
+        return;
+      case TpComplex:
+        putDataBorrowed<Complex> (self, value, blc, inc);
+        return;
+      case TpDComplex:
+        putDataBorrowed<DComplex> (self, value, blc, inc);
+        return;
+      default:
+        break;
+      }
+    }
+    self.putData (pyToValueHolder (value), blc, inc);
+  }
+
+  // The number of bytes copied by the zero-copy converters of this module.
+  Int64 bytesCopied()
+  {
+    return pyBufferBytesCopied();
+  }
+
   void pyimages()
   {
+    def ("_bytescopied", &bytesCopied);
+
     // Note that all constructors must have a different number of arguments.
     class_<ImageProxy> ("Image")
             // 1 arg: copy constructor
@@ -65,9 +579,11 @@ namespace casacore { namespace python {
       .def ("_size", &ImageProxy::size)
       .def ("_datatype", &ImageProxy::dataType)
       .def ("_imagetype", &ImageProxy::imageType)
-      .def ("_getdata", &ImageProxy::getData)
+      .def ("_getdata", &getDataNoCopy)
       .def ("_getmask", &ImageProxy::getMask)
-      .def ("_putdata", &ImageProxy::putData)
+      .def ("_getdatanogil", &getDataNoGIL)
+      .def ("_nicecursorshape", &niceCursorShape)
+      .def ("_putdata", &putDataNoCopy)
       .def ("_putmask", &ImageProxy::putMask)
       .def ("_haslock", &ImageProxy::hasLock,
  	    (boost::python::arg("write")))
@@ -126,6 +642,17 @@ namespace casacore { namespace python {
              boost::python::arg("bitpix"),
              boost::python::arg("minpix"),
              boost::python::arg("maxpix")))
+      .def ("_tofitschunked", &toFitsChunked,
+            (boost::python::arg("filename"),
+             boost::python::arg("overwrite"),
+             boost::python::arg("velocity"),
+             boost::python::arg("optical"),
+             boost::python::arg("bitpix"),
+             boost::python::arg("minpix"),
+             boost::python::arg("maxpix"),
+             boost::python::arg("memory"),
+             boost::python::arg("nthreads"),
+             boost::python::arg("progress")))
       .def ("_saveas", &ImageProxy::saveAs,
             (boost::python::arg("filename"),
              boost::python::arg("overwrite"),
@@ -133,6 +660,13 @@ namespace casacore { namespace python {
              boost::python::arg("copymask"),
              boost::python::arg("newmaskname"),
              boost::python::arg("newtileshape")))
+      .def ("_saveascompressed", &saveAsCompressed,
+            (boost::python::arg("filename"),
+             boost::python::arg("overwrite"),
+             boost::python::arg("copymask"),
+             boost::python::arg("newmaskname"),
+             boost::python::arg("newtileshape"),
+             boost::python::arg("codec")))
       .def ("_statistics", &ImageProxy::statistics,
             (boost::python::arg("axes"),
              boost::python::arg("mask"), 
@@ -25,6 +25,8 @@
 //#
 //# $Id: pymeas.cc,v 1.1 2006/09/28 05:55:00 mmarquar Exp $
 
+#include "pyrecord.h"
+
 #include <boost/python.hpp>
 #include <boost/python/args.hpp>
 #include <casacore/measures/Measures/MeasuresProxy.h>
@@ -34,11 +36,33 @@
 using namespace boost::python;
 
 namespace casacore { namespace python {
+
+  // The measure conversions are called for many epochs or directions, so
+  // their result records are converted with RecordConverter.
+  boost::python::dict measureDict (MeasuresProxy& self, const Record& rec,
+                                   const String& str, const Record& form)
+  {
+    RecordConverter converter;
+    return converter.toDict (self.measure (rec, str, form));
+  }
+
+  boost::python::dict uvwDict (MeasuresProxy& self, const Record& rec)
+  {
+    RecordConverter converter;
+    return converter.toDict (self.uvw (rec));
+  }
+
+  boost::python::dict expandDict (MeasuresProxy& self, const Record& rec)
+  {
+    RecordConverter converter;
+    return converter.toDict (self.expand (rec));
+  }
+
   void pymeas()
   {
     class_<MeasuresProxy> ("measures")
       .def (init<>())
-      .def ("measure", &MeasuresProxy::measure)
+      .def ("measure", &measureDict)
       .def ("dirshow", &MeasuresProxy::dirshow)
       .def ("doframe", &MeasuresProxy::doframe)
       .def ("linelist", &MeasuresProxy::linelist)      
@@ -53,8 +77,8 @@ namespace casacore { namespace python {
       .def ("torest", &MeasuresProxy::torest)
       .def ("separation", &MeasuresProxy::separation)
       .def ("posangle", &MeasuresProxy::posangle)
-      .def ("uvw", &MeasuresProxy::uvw)
-      .def ("expand", &MeasuresProxy::expand)
+      .def ("uvw", &uvwDict)
+      .def ("expand", &expandDict)
       .def ("alltyp", &MeasuresProxy::alltyp)
         ;
   }
@@ -0,0 +1,526 @@
+//# pymeasconv.cc: python module for converting arrays of measure values
+//# Copyright (C) 2017
+//# Associated Universities, Inc. Washington DC, USA.
+//#
+//# This library is free software; you can redistribute it and/or modify it
+//# under the terms of the GNU Library General Public License as published by
+//# the Free Software Foundation; either version 2 of the License, or (at your
+//# option) any later version.
+//#
+//# This library is distributed in the hope that it will be useful, but WITHOUT
+//# ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//# FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+//# License for more details.
+//#
+//# You should have received a copy of the GNU Library General Public License
+//# along with this library; if not, write to the Free Software Foundation,
+//# Inc., 675 Massachusetts Ave, Cambridge, MA 02139, USA.
+//#
+//# Correspondence concerning AIPS++ should be addressed as follows:
+//#        Internet email: aips2-request@nrao.edu.
+//#        Postal address: AIPS++ Project Office
+//#                        National Radio Astronomy Observatory
+//#                        520 Edgemont Road
+//#                        Charlottesville, VA 22903-2475 USA
+//#
+//# $Id: $
+
+#include "pymeasures.h"
+#include "pygil.h"
+#include "pythreads.h"
+
+#include <casacore/measures/Measures/MeasFrame.h>
+#include <casacore/measures/Measures/MeasureHolder.h>
+#include <casacore/measures/Measures/MDirection.h>
+#include <casacore/measures/Measures/MPosition.h>
+#include <casacore/measures/Measures/MEpoch.h>
+#include <casacore/measures/Measures/MCDirection.h>
+#include <casacore/measures/Measures/MCPosition.h>
+#include <casacore/measures/Measures/MCEpoch.h>
+#include <casacore/measures/Measures/MBaseline.h>
+#include <casacore/measures/Measures/MCBaseline.h>
+#include <casacore/measures/Measures/Precession.h>
+#include <casacore/measures/Measures/Nutation.h>
+#include <casacore/measures/Measures/Aberration.h>
+#include <casacore/casa/Quanta/MVBaseline.h>
+#include <casacore/casa/Quanta/MVuvw.h>
+#include <casacore/casa/System/AipsrcValue.h>
+#include <casacore/casa/Quanta/Unit.h>
+#include <casacore/casa/Arrays/Array.h>
+#include <casacore/casa/Arrays/Vector.h>
+#include <casacore/casa/Containers/Record.h>
+#include <casacore/casa/Containers/ValueHolder.h>
+#include <casacore/casa/Exceptions/Error.h>
+#include <casacore/python/Converters/PycBasicData.h>
+#include <casacore/python/Converters/PycValueHolder.h>
+#include <casacore/python/Converters/PycRecord.h>
+
+#include <boost/python.hpp>
+#include <boost/python/args.hpp>
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+using namespace boost::python;
+
+namespace casacore { namespace python {
+
+  // The traits below tell how the values of a measure type are stored
+  // in the flat arrays: directions as (lon,lat) in rad, positions as
+  // (x,y,z) in m, and epochs as MJD in seconds.
+  struct DirectionValues
+  {
+    typedef MDirection M;
+    enum {NV=2};
+    static MVDirection toMV (const Double* v)
+      { return MVDirection (v[0], v[1]); }
+    static void fromM (const MDirection& m, Double* v)
+    {
+      Vector<Double> lonlat = m.getValue().get();
+      v[0] = lonlat[0];
+      v[1] = lonlat[1];
+    }
+  };
+
+  struct PositionValues
+  {
+    typedef MPosition M;
+    enum {NV=3};
+    static MVPosition toMV (const Double* v)
+      { return MVPosition (v[0], v[1], v[2]); }
+    static void fromM (const MPosition& m, Double* v)
+    {
+      const Vector<Double>& xyz = m.getValue().getValue();
+      v[0] = xyz[0];
+      v[1] = xyz[1];
+      v[2] = xyz[2];
+    }
+  };
+
+  struct EpochValues
+  {
+    typedef MEpoch M;
+    enum {NV=1};
+    static MVEpoch toMV (const Double* v)
+      { return MVEpoch (v[0] / 86400.); }
+    static void fromM (const MEpoch& m, Double* v)
+      { v[0] = m.getValue().get() * 86400.; }
+  };
+
+  // Make a frame from a record containing measures as subrecords.
+  MeasFrame makeFrame (const Record& rec)
+  {
+    MeasFrame frame;
+    for (uInt i=0; i<rec.nfields(); ++i) {
+      MeasureHolder mh;
+      String err;
+      if (!mh.fromRecord (err, rec.subRecord(i))) {
+        throw AipsError ("Invalid frame measure " + rec.name(i) + ": " + err);
+      }
+      frame.set (mh.asMeasure());
+    }
+    return frame;
+  }
+
+  // Convert n values using a single conversion engine.
+  // If epochs are given, the frame epoch is reset for each value, but
+  // only if it differs from the previous one.
+  template<typename T>
+  void convertValues (const String& inRef, const String& outRef,
+                      MeasFrame& frame, const Double* in, Double* out,
+                      size_t n, const Double* epochs,
+                      MEpoch::Types epochType)
+  {
+    typename T::M::Types inType, outType;
+    if (!T::M::getType (inType, inRef)) {
+      throw AipsError ("Unknown input reference type " + inRef);
+    }
+    if (!T::M::getType (outType, outRef)) {
+      throw AipsError ("Unknown output reference type " + outRef);
+    }
+    if (n == 0) {
+      return;
+    }
+    if (epochs) {
+      frame.set (MEpoch (MVEpoch (epochs[0] / 86400.), epochType));
+    }
+    typename T::M::Convert conv (typename T::M::Ref (inType, frame),
+                                 typename T::M::Ref (outType, frame));
+    Double lastEpoch = epochs ? epochs[0] : 0;
+    for (size_t i=0; i<n; ++i) {
+      if (epochs  &&  epochs[i] != lastEpoch) {
+        lastEpoch = epochs[i];
+        frame.resetEpoch (MVEpoch (lastEpoch / 86400.));
+      }
+      T::fromM (conv (T::toMV (in + i*T::NV)), out + i*T::NV);
+    }
+  }
+
+  // Convert the values in parallel. Each thread converts a contiguous
+  // part of the values (keeping their time order) using its own frame and
+  // conversion engine, so the cached frame calculations are not shared.
+  // A value is converted first by the calling thread, because casacore
+  // fills its static measures tables (IERS, etc.) on first use.
+  template<typename T>
+  void convertParallel (const String& inRef, const String& outRef,
+                        const Record& frameRec, const Double* in,
+                        Double* out, size_t n, const Double* epochs,
+                        MEpoch::Types epochType, uInt nthreads)
+  {
+    nthreads = nrThreads (nthreads, n);
+    if (nthreads <= 1) {
+      MeasFrame frame (makeFrame (frameRec));
+      convertValues<T> (inRef, outRef, frame, in, out, n, epochs, epochType);
+      return;
+    }
+    std::vector<MeasFrame> frames;
+    for (uInt i=0; i<=nthreads; ++i) {
+      frames.push_back (makeFrame (frameRec));
+    }
+    convertValues<T> (inRef, outRef, frames[nthreads], in, out, 1,
+                      epochs, epochType);
+    runParts (n, nthreads, [&] (uInt i, size_t st, size_t end) {
+      convertValues<T> (inRef, outRef, frames[i],
+                        in + st*T::NV, out + st*T::NV, end-st,
+                        epochs ? epochs+st : 0, epochType);
+    });
+  }
+
+  // Check the shape of the values and return the number of measures.
+  size_t nrMeasures (const IPosition& shape, uInt nv)
+  {
+    if (nv > 1  &&  (shape.empty()  ||  shape[0] != Int(nv))) {
+      throw AipsError ("The last axis of the values array must have length "
+                       + String::toString(nv));
+    }
+    return shape.empty() ? 0 : shape.product() / nv;
+  }
+
+  template<typename T>
+  ValueHolder convertArray (const Array<Double>& values,
+                            const String& inRef, const String& outRef,
+                            const Array<Double>& epochs,
+                            MEpoch::Types epochType, const Record& frameRec,
+                            uInt nthreads)
+  {
+    size_t n = nrMeasures (values.shape(), T::NV);
+    if (epochs.size() > 0  &&  epochs.size() != n) {
+      throw AipsError ("The number of frame epochs must match the number "
+                       "of values");
+    }
+    Array<Double> out (values.shape());
+    Bool deleteIn, deleteEpochs, deleteOut;
+    const Double* inPtr = values.getStorage (deleteIn);
+    const Double* epochPtr = epochs.getStorage (deleteEpochs);
+    Double* outPtr = out.getStorage (deleteOut);
+    try {
+      ReleaseGIL release;
+      convertParallel<T> (inRef, outRef, frameRec, inPtr, outPtr, n,
+                          epochs.size() > 0 ? epochPtr : 0, epochType,
+                          nthreads);
+    } catch (...) {
+      values.freeStorage (inPtr, deleteIn);
+      epochs.freeStorage (epochPtr, deleteEpochs);
+      out.putStorage (outPtr, deleteOut);
+      throw;
+    }
+    values.freeStorage (inPtr, deleteIn);
+    epochs.freeStorage (epochPtr, deleteEpochs);
+    out.putStorage (outPtr, deleteOut);
+    return ValueHolder (out);
+  }
+
+  // Convert an array of measure values of the given type from one
+  // reference type to another using nthreads threads (0 = all cores).
+  ValueHolder convertMany (const String& type, const ValueHolder& values,
+                           const String& inRef, const String& outRef,
+                           const ValueHolder& epochs, const String& epochRef,
+                           const Record& frame, uInt nthreads)
+  {
+    MEpoch::Types epochType;
+    if (!MEpoch::getType (epochType, epochRef)) {
+      throw AipsError ("Unknown epoch reference type " + epochRef);
+    }
+    Array<Double> vals (values.asArrayDouble());
+    Array<Double> times (epochs.asArrayDouble());
+    String utype (type);
+    utype.upcase();
+    if (utype == "DIRECTION") {
+      return convertArray<DirectionValues> (vals, inRef, outRef, times,
+                                            epochType, frame, nthreads);
+    } else if (utype == "POSITION") {
+      return convertArray<PositionValues> (vals, inRef, outRef, times,
+                                           epochType, frame, nthreads);
+    } else if (utype == "EPOCH") {
+      return convertArray<EpochValues> (vals, inRef, outRef, times,
+                                        epochType, frame, nthreads);
+    }
+    throw AipsError ("convert_many cannot handle measure type " + type);
+  }
+
+  // Calculate the 3x3 matrix (row-major) converting an ITRF position to
+  // its J2000 uvw for the phase center at the frame's epoch.
+  // The conversion is a rotation, so it is found by converting the
+  // ITRF unit vectors.
+  void uvwMatrix (MBaseline::Convert& baseConv, MDirection::Convert& dirConv,
+                  const MVDirection& phaseCenter, Double* matrix)
+  {
+    MVDirection dir (dirConv(phaseCenter).getValue());
+    for (uInt j=0; j<3; ++j) {
+      MVBaseline unit (j==0 ? 1:0, j==1 ? 1:0, j==2 ? 1:0);
+      MVuvw uvw (baseConv(unit).getValue(), dir);
+      const Vector<Double>& v = uvw.getValue();
+      for (uInt k=0; k<3; ++k) {
+        matrix[3*k+j] = v[k];
+      }
+    }
+  }
+
+  // Calculate the uvw of all antennas for the epochs [st,end).
+  void uvwTimes (MeasFrame& frame, const MDirection& phaseCenter,
+                 MEpoch::Types epochType, const Double* pos, size_t nant,
+                 const Double* epochs, size_t st, size_t end, Double* out)
+  {
+    if (st >= end) {
+      return;
+    }
+    frame.set (MEpoch (MVEpoch (epochs[st] / 86400.), epochType));
+    MBaseline::Convert baseConv (MBaseline::Ref (MBaseline::ITRF, frame),
+                                 MBaseline::Ref (MBaseline::J2000));
+    MDirection::Types dirType =
+      MDirection::castType (phaseCenter.getRef().getType());
+    MDirection::Convert dirConv (MDirection::Ref (dirType, frame),
+                                 MDirection::Ref (MDirection::J2000));
+    Double matrix[9];
+    for (size_t t=st; t<end; ++t) {
+      frame.resetEpoch (MVEpoch (epochs[t] / 86400.));
+      uvwMatrix (baseConv, dirConv, phaseCenter.getValue(), matrix);
+      Double* uvw = out + t*nant*3;
+      for (size_t a=0; a<nant; ++a) {
+        const Double* p = pos + a*3;
+        for (uInt k=0; k<3; ++k) {
+          uvw[3*a+k] = (matrix[3*k]   * p[0] +
+                        matrix[3*k+1] * p[1] +
+                        matrix[3*k+2] * p[2]);
+        }
+      }
+    }
+  }
+
+  // Calculate the J2000 uvw of the antennas (ITRF x,y,z in m) for all
+  // epochs (MJD in s). The result has shape [ntime,nant,3].
+  ValueHolder uvwGrid (const ValueHolder& positions,
+                       const ValueHolder& epochs,
+                       const Record& phaseCenter, const String& epochRef,
+                       const Record& frameRec, uInt nthreads)
+  {
+    MEpoch::Types epochType;
+    if (!MEpoch::getType (epochType, epochRef)) {
+      throw AipsError ("Unknown epoch reference type " + epochRef);
+    }
+    MeasureHolder mh;
+    String err;
+    if (!mh.fromRecord (err, phaseCenter)  ||  !mh.isMDirection()) {
+      throw AipsError ("The phase center must be a direction measure " + err);
+    }
+    MDirection dir (mh.asMDirection());
+    Array<Double> pos (positions.asArrayDouble());
+    Array<Double> times (epochs.asArrayDouble());
+    size_t nant  = nrMeasures (pos.shape(), 3);
+    size_t ntime = times.size();
+    Array<Double> out (IPosition(3, 3, nant, ntime));
+    nthreads = nrThreads (nthreads, ntime);
+    std::vector<MeasFrame> frames;
+    for (uInt i=0; i<=nthreads; ++i) {
+      frames.push_back (makeFrame (frameRec));
+    }
+    Bool deletePos, deleteTimes, deleteOut;
+    const Double* posPtr = pos.getStorage (deletePos);
+    const Double* timePtr = times.getStorage (deleteTimes);
+    Double* outPtr = out.getStorage (deleteOut);
+    try {
+      ReleaseGIL release;
+      // Do the first epoch in this thread to fill the static tables.
+      uvwTimes (frames[nthreads], dir, epochType, posPtr, nant, timePtr,
+                0, std::min(ntime, size_t(1)), outPtr);
+      if (nthreads <= 1) {
+        uvwTimes (frames[0], dir, epochType, posPtr, nant, timePtr,
+                  0, ntime, outPtr);
+      } else {
+        runParts (ntime, nthreads, [&] (uInt i, size_t st, size_t end) {
+          uvwTimes (frames[i], dir, epochType, posPtr, nant, timePtr,
+                    st, end, outPtr);
+        });
+      }
+    } catch (...) {
+      pos.freeStorage (posPtr, deletePos);
+      times.freeStorage (timePtr, deleteTimes);
+      out.putStorage (outPtr, deleteOut);
+      throw;
+    }
+    pos.freeStorage (posPtr, deletePos);
+    times.freeStorage (timePtr, deleteTimes);
+    out.putStorage (outPtr, deleteOut);
+    return ValueHolder (out);
+  }
+
+  // Make the MVDirection objects for an array of (lon,lat) values.
+  std::vector<MVDirection> makeDirections (const Array<Double>& values)
+  {
+    size_t n = nrMeasures (values.shape(), 2);
+    Array<Double> vals (values.shape());
+    vals = values;               // make sure the data are contiguous
+    const Double* v = vals.data();
+    std::vector<MVDirection> dirs;
+    dirs.reserve (n);
+    for (size_t i=0; i<n; ++i) {
+      dirs.push_back (MVDirection (v[2*i], v[2*i+1]));
+    }
+    return dirs;
+  }
+
+  // Calculate the separation or position angle (in rad) between the
+  // directions given as (lon,lat) in rad.
+  // If outer is True, it is done for all combinations giving a result with
+  // shape [n1,n2]. Otherwise it is done for the pairs (i,i) giving shape [n];
+  // a single direction is paired with all directions in the other array.
+  ValueHolder directionAngles (const ValueHolder& values1,
+                               const ValueHolder& values2,
+                               Bool outer, Bool posAngle)
+  {
+    std::vector<MVDirection> dirs1 = makeDirections (values1.asArrayDouble());
+    std::vector<MVDirection> dirs2 = makeDirections (values2.asArrayDouble());
+    size_t n1 = dirs1.size();
+    size_t n2 = dirs2.size();
+    IPosition shape;
+    if (outer) {
+      shape = IPosition (2, n2, n1);
+    } else if (n1 == n2  ||  n1 == 1  ||  n2 == 1) {
+      shape = IPosition (1, std::max (n1, n2));
+    } else {
+      throw AipsError ("Direction arrays have different lengths");
+    }
+    Array<Double> out (shape);
+    Double* res = out.data();
+    {
+      ReleaseGIL release;
+      if (outer) {
+        for (size_t i=0; i<n1; ++i) {
+          for (size_t j=0; j<n2; ++j) {
+            *res++ = (posAngle ? dirs1[i].positionAngle (dirs2[j]) :
+                                 dirs1[i].separation (dirs2[j]));
+          }
+        }
+      } else {
+        for (size_t i=0; i<out.size(); ++i) {
+          const MVDirection& d1 = dirs1[n1==1 ? 0 : i];
+          const MVDirection& d2 = dirs2[n2==1 ? 0 : i];
+          *res++ = (posAngle ? d1.positionAngle (d2) : d1.separation (d2));
+        }
+      }
+    }
+    return ValueHolder (out);
+  }
+
+  // Make sure casacore's Precession, Nutation and Aberration classes have
+  // registered their interval keywords. Registering a keyword (re)reads its
+  // value from .casarc (or takes the default), so a value set before
+  // casacore's own (lazy) registration would be lost. A calculation for an
+  // arbitrary epoch forces the registration.
+  void registerCasacoreIntervals()
+  {
+    static Bool done = False;
+    if (!done) {
+      Precession prec;
+      prec (51544.5);
+      Nutation nut;
+      nut (51544.5);
+      Aberration aber;
+      aber (51544.5);
+      done = True;
+    }
+  }
+
+  // Get the registration index of the interval (in days) within which
+  // casacore does not recalculate the precession, nutation, or aberration,
+  // but extrapolates linearly from the last calculated epoch.
+  // The keywords are the ones used by casacore's Precession, Nutation and
+  // Aberration classes, so they can also be set in .casarc.
+  // Each keyword is registered only once, because registering resets the
+  // value. The GIL protects the static map.
+  uInt intervalIndex (const String& name)
+  {
+    String uname (name);
+    uname.downcase();
+    static std::map<String,uInt> indices;
+    std::map<String,uInt>::const_iterator iter = indices.find (uname);
+    if (iter != indices.end()) {
+      return iter->second;
+    }
+    // These are the defaults used by casacore.
+    Double defInterval;
+    if (uname == "precession") {
+      defInterval = 0.1;
+    } else if (uname == "nutation"  ||  uname == "aberration") {
+      defInterval = 0.04;
+    } else {
+      throw AipsError ("No interpolation interval for " + name +
+                       "; use precession, nutation, or aberration");
+    }
+    registerCasacoreIntervals();
+    // The keyword is already registered by casacore, so its index is
+    // returned.
+    uInt index = AipsrcValue<Double>::registerRC ("measures." + uname +
+                                                  ".d_interval",
+                                                  Unit("d"), Unit("d"),
+                                                  defInterval);
+    indices[uname] = index;
+    return index;
+  }
+
+  Double getInterval (const String& name)
+  {
+    return AipsrcValue<Double>::get (intervalIndex (name));
+  }
+
+  // Set the interval and return the old one.
+  Double setInterval (const String& name, Double days)
+  {
+    uInt index = intervalIndex (name);
+    Double old = AipsrcValue<Double>::get (index);
+    AipsrcValue<Double>::set (index, days);
+    return old;
+  }
+
+  void pymeasconv()
+  {
+    def ("_convert_many", &convertMany,
+         (boost::python::arg("type"),
+          boost::python::arg("values"),
+          boost::python::arg("inref"),
+          boost::python::arg("outref"),
+          boost::python::arg("epochs"),
+          boost::python::arg("epochref"),
+          boost::python::arg("frame"),
+          boost::python::arg("nthreads")));
+    def ("_uvw_grid", &uvwGrid,
+         (boost::python::arg("positions"),
+          boost::python::arg("epochs"),
+          boost::python::arg("phasecenter"),
+          boost::python::arg("epochref"),
+          boost::python::arg("frame"),
+          boost::python::arg("nthreads")));
+    def ("_direction_angles", &directionAngles,
+         (boost::python::arg("values1"),
+          boost::python::arg("values2"),
+          boost::python::arg("outer"),
+          boost::python::arg("posangle")));
+    def ("_get_interval", &getInterval,
+         (boost::python::arg("name")));
+    def ("_set_interval", &setInterval,
+         (boost::python::arg("name"),
+          boost::python::arg("days")));
+  }
+
+}}
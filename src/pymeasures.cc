@@ -28,7 +28,7 @@
 #include <boost/python.hpp>
 #include <casacore/python/Converters/PycExcp.h>
 #include <casacore/python/Converters/PycBasicData.h>
-//#include <casacore/python/Converters/PycValueHolder.h>
+#include <casacore/python/Converters/PycValueHolder.h>
 #include <casacore/python/Converters/PycRecord.h>
 #include "pymeasures.h"
 
@@ -36,7 +36,9 @@ BOOST_PYTHON_MODULE(_measures)
 {
   casa::python::register_convert_excp();
   casa::python::register_convert_basicdata();
+  casa::python::register_convert_casa_valueholder();
   casa::python::register_convert_casa_record();
 
   casa::python::pymeas();
+  casa::python::pymeasconv();
 }
@@ -33,6 +33,7 @@
 namespace casacore {
   namespace python {
     void pymeas();
+    void pymeasconv();
   } // python
 } //casa
 
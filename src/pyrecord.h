@@ -0,0 +1,257 @@
+//# pyrecord.h: convert casacore Records to Python dicts using a cached plan
+//# Copyright (C) 2017
+//# Associated Universities, Inc. Washington DC, USA.
+//#
+//# This library is free software; you can redistribute it and/or modify it
+//# under the terms of the GNU Library General Public License as published by
+//# the Free Software Foundation; either version 2 of the License, or (at your
+//# option) any later version.
+//#
+//# This library is distributed in the hope that it will be useful, but WITHOUT
+//# ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//# FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+//# License for more details.
+//#
+//# You should have received a copy of the GNU Library General Public License
+//# along with this library; if not, write to the Free Software Foundation,
+//# Inc., 675 Massachusetts Ave, Cambridge, MA 02139, USA.
+//#
+//# Correspondence concerning AIPS++ should be addressed as follows:
+//#        Internet email: aips2-request@nrao.edu.
+//#        Postal address: AIPS++ Project Office
+//#                        National Radio Astronomy Observatory
+//#                        520 Edgemont Road
+//#                        Charlottesville, VA 22903-2475 USA
+//#
+//# $Id: $
+
+#ifndef PYRAP_PYRECORD_H
+#define PYRAP_PYRECORD_H
+
+// RecordConverter converts a casacore Record into a Python dict.
+// The normal converter makes a new key string for each field of each record.
+// RecordConverter keeps a plan (the field names and types, and the key
+// objects) for the last record description seen, so converting many records
+// with the same description (e.g. successive rows of a table) only needs
+// to check the description and convert the values. Scalars are converted
+// directly; numeric arrays are handed to numpy without a copy.
+// <br>LazyRecord holds a Record and converts a field only when it is asked
+// for, which is cheaper when only a few fields of a large record are used.
+
+#include "pybuffer.h"
+
+#include <casacore/casa/Containers/Record.h>
+#include <casacore/casa/Containers/RecordDesc.h>
+#include <casacore/casa/Exceptions/Error.h>
+
+#include <boost/python.hpp>
+
+#include <memory>
+#include <vector>
+
+namespace casacore {
+  namespace python {
+
+    class RecordConverter
+    {
+    public:
+      RecordConverter()
+      {}
+
+      // Convert the record to a dict.
+      boost::python::dict toDict (const Record& rec)
+      {
+        makePlan (rec.description());
+        boost::python::dict d;
+        for (uInt i=0; i<itsKeys.size(); ++i) {
+          boost::python::object value (field (rec, i));
+          if (PyDict_SetItem (d.ptr(), itsKeys[i].ptr(), value.ptr()) < 0) {
+            boost::python::throw_error_already_set();
+          }
+        }
+        return d;
+      }
+
+      // Convert the i-th field of the record.
+      // The plan must have been made for the record's description.
+      boost::python::object field (const Record& rec, uInt i)
+      {
+        RecordFieldId fld(i);
+        PyObject* obj = 0;
+        switch (itsTypes[i]) {
+        case TpBool:
+          obj = PyBool_FromLong (rec.asBool(fld));
+          break;
+        case TpUChar:
+          obj = PyLong_FromLong (rec.asuChar(fld));
+          break;
+        case TpShort:
+          obj = PyLong_FromLong (rec.asShort(fld));
+          break;
+        case TpInt:
+          obj = PyLong_FromLong (rec.asInt(fld));
+          break;
+        case TpUInt:
+          obj = PyLong_FromUnsignedLong (rec.asuInt(fld));
+          break;
+        case TpInt64:
+          obj = PyLong_FromLongLong (rec.asInt64(fld));
+          break;
+        case TpFloat:
+          obj = PyFloat_FromDouble (rec.asFloat(fld));
+          break;
+        case TpDouble:
+          obj = PyFloat_FromDouble (rec.asDouble(fld));
+          break;
+        case TpComplex:
+          {
+            const Complex& v = rec.asComplex(fld);
+            obj = PyComplex_FromDoubles (v.real(), v.imag());
+          }
+          break;
+        case TpDComplex:
+          {
+            const DComplex& v = rec.asDComplex(fld);
+            obj = PyComplex_FromDoubles (v.real(), v.imag());
+          }
+          break;
+        case TpString:
+          {
+            const String& v = rec.asString(fld);
+            return boost::python::str (v.data(), v.size());
+          }
+        case TpRecord:
+          return itsSubs[i]->toDict (rec.subRecord(fld));
+        default:
+          {
+            // The record keeps its value, so numpy gets a copy.
+            ValueHolder vh (rec.asValueHolder(fld));
+            return valueHolderToPython (vh);
+          }
+        }
+        if (obj == 0) {
+          boost::python::throw_error_already_set();
+        }
+        return boost::python::object (boost::python::handle<>(obj));
+      }
+
+      // Get the index of the field with the given key (-1 if not found).
+      // The plan must have been made for the record's description.
+      Int fieldNumber (const String& name) const
+      {
+        for (uInt i=0; i<itsNames.size(); ++i) {
+          if (itsNames[i] == name) {
+            return i;
+          }
+        }
+        return -1;
+      }
+
+      // Make the plan for the given description, unless the current plan
+      // already matches it.
+      void makePlan (const RecordDesc& desc)
+      {
+        const uInt nf = desc.nfields();
+        Bool match = (nf == itsNames.size());
+        for (uInt i=0; match && i<nf; ++i) {
+          match = (desc.type(i) == itsTypes[i]  &&  desc.name(i) == itsNames[i]);
+        }
+        if (match) {
+          return;
+        }
+        itsNames.resize (nf);
+        itsTypes.resize (nf);
+        itsKeys.resize (nf);
+        itsSubs.resize (nf);
+        for (uInt i=0; i<nf; ++i) {
+          itsNames[i] = desc.name(i);
+          itsTypes[i] = desc.type(i);
+#if PY_MAJOR_VERSION < 3
+          PyObject* key = PyString_InternFromString (itsNames[i].c_str());
+#else
+          PyObject* key = PyUnicode_InternFromString (itsNames[i].c_str());
+#endif
+          if (key == 0) {
+            boost::python::throw_error_already_set();
+          }
+          itsKeys[i] = boost::python::object (boost::python::handle<>(key));
+          if (itsTypes[i] == TpRecord) {
+            // Subrecords get their own plan, which is kept if possible.
+            if (! itsSubs[i]) {
+              itsSubs[i].reset (new RecordConverter());
+            }
+          } else {
+            itsSubs[i].reset();
+          }
+        }
+      }
+
+      // Get the key objects of the current plan as a tuple.
+      boost::python::tuple keys() const
+      {
+        boost::python::list l;
+        for (uInt i=0; i<itsKeys.size(); ++i) {
+          l.append (itsKeys[i]);
+        }
+        return boost::python::tuple(l);
+      }
+
+    private:
+      std::vector<String>                 itsNames;
+      std::vector<DataType>               itsTypes;
+      std::vector<boost::python::object>  itsKeys;
+      std::vector<std::shared_ptr<RecordConverter> > itsSubs;
+    };
+
+
+    class LazyRecord
+    {
+    public:
+      LazyRecord (const Record& rec,
+                  const std::shared_ptr<RecordConverter>& converter)
+        : itsRecord    (rec),
+          itsConverter (converter)
+      {
+        itsConverter->makePlan (itsRecord.description());
+        itsKeys = itsConverter->keys();
+      }
+
+      // Get the keys (in field order).
+      boost::python::tuple keys() const
+        { return itsKeys; }
+
+      // Get the number of fields.
+      uInt size() const
+        { return itsRecord.nfields(); }
+
+      // Tell if the field exists.
+      Bool contains (const String& name) const
+        { return itsRecord.fieldNumber(name) >= 0; }
+
+      // Convert the given field. An exception is thrown if it does not exist.
+      boost::python::object get (const String& name) const
+      {
+        Int fld = itsRecord.fieldNumber (name);
+        if (fld < 0) {
+          throw AipsError ("LazyRecord: field " + name + " does not exist");
+        }
+        // The converter can be shared with other records, so make sure
+        // its plan is the one for this record.
+        itsConverter->makePlan (itsRecord.description());
+        return itsConverter->field (itsRecord, fld);
+      }
+
+      // Convert all fields to a dict.
+      boost::python::dict toDict() const
+        { return itsConverter->toDict (itsRecord); }
+
+    private:
+      Record                            itsRecord;
+      std::shared_ptr<RecordConverter>  itsConverter;
+      boost::python::tuple              itsKeys;
+    };
+
+  } // python
+} //casa
+
+#endif
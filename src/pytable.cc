@@ -25,7 +25,16 @@
 //#
 //# $Id: pytable.cc,v 1.5 2006/11/08 00:12:55 gvandiep Exp $
 
+#include "pybuffer.h"
+#include "pyrecord.h"
+
 #include <casacore/tables/Tables/TableProxy.h>
+#include <casacore/tables/Tables/TableColumn.h>
+#include <casacore/tables/Tables/ArrayColumn.h>
+#include <casacore/tables/Tables/ColumnDesc.h>
+#include <casacore/casa/Arrays/Vector.h>
+#include <casacore/casa/Arrays/Matrix.h>
+#include <casacore/casa/Exceptions/Error.h>
 
 #include <casacore/python/Converters/PycBasicData.h>
 #include <casacore/python/Converters/PycValueHolder.h>
@@ -34,12 +43,491 @@
 #include <boost/python.hpp>
 #include <boost/python/args.hpp>
 
+#include <algorithm>
+#include <vector>
+
 using namespace boost::python;
 
 namespace casacore { namespace python {
 
+  // Get the data of a column, handing numeric arrays to numpy without
+  // copying them.
+  boost::python::object getColumnNoCopy (TableProxy& self,
+                                         const String& columnName,
+                                         Int startrow, Int nrow, Int rowincr)
+  {
+    ValueHolder data (self.getColumn (columnName, startrow, nrow, rowincr));
+    return valueHolderToPython (data);
+  }
+
+  // Get the description of the table as a dict.
+  boost::python::dict getTableDescDict (TableProxy& self, Bool actual,
+                                        Bool cOrder)
+  {
+    RecordConverter converter;
+    return converter.toDict (self.getTableDescription (actual, cOrder));
+  }
+
+  // Get the description of a column as a dict.
+  boost::python::dict getColumnDescDict (TableProxy& self,
+                                         const String& columnName,
+                                         Bool actual, Bool cOrder)
+  {
+    RecordConverter converter;
+    return converter.toDict (self.getColumnDescription (columnName, actual,
+                                                        cOrder));
+  }
+
+  // Get the data manager info as a dict.
+  boost::python::dict getDataManagerInfoDict (TableProxy& self)
+  {
+    RecordConverter converter;
+    return converter.toDict (self.getDataManagerInfo());
+  }
+
+  template<typename T>
+  void putColumnBorrowed (TableProxy& self, const String& columnName,
+                          Int startrow, Int nrow, Int rowincr,
+                          PyObject* value)
+  {
+    BorrowedArray<T> arr (value);
+    self.putColumn (columnName, startrow, nrow, rowincr,
+                    ValueHolder(arr.array()));
+  }
+
+  // Put the data of a column, using the memory of a numpy array of the
+  // column's data type without copying it. Other values use the normal
+  // conversion.
+  void putColumnNoCopy (TableProxy& self, const String& columnName,
+                        Int startrow, Int nrow, Int rowincr, PyObject* value)
+  {
+    if (pyBufferIsArray (value)) {
+      switch (self.table().tableDesc().columnDesc(columnName).dataType()) {
+      case TpBool:
+        putColumnBorrowed<Bool> (self, columnName, startrow, nrow, rowincr,
+                                 value);
+        return;
+      case TpUChar:
+        putColumnBorrowed<uChar> (self, columnName, startrow, nrow, rowincr,
+                                  value);
+        return;
+      case TpShort:
+        putColumnBorrowed<Short> (self, columnName, startrow, nrow, rowincr,
+                                  value);
+        return;
+      case TpInt:
+        putColumnBorrowed<Int> (self, columnName, startrow, nrow, rowincr,
+                                value);
+        return;
+      case TpUInt:
+        putColumnBorrowed<uInt> (self, columnName, startrow, nrow, rowincr,
+                                 value);
+        return;
+      case TpInt64:
+        putColumnBorrowed<Int64> (self, columnName, startrow, nrow, rowincr,
+                                  value);
+        return;
+      case TpFloat:
+        putColumnBorrowed<Float> (self, columnName, startrow, nrow, rowincr,
+                                  value);
+        return;
+      case TpDouble:
+        putColumnBorrowed<Double> (self, columnName, startrow, nrow, rowincr,
+                                   value);
+        return;
+      case TpComplex:
+        putColumnBorrowed<Complex> (self, columnName, startrow, nrow,
+                                    rowincr, value);
+        return;
+      case TpDComplex:
+        putColumnBorrowed<DComplex> (self, columnName, startrow, nrow,
+                                     rowincr, value);
+        return;
+      default:
+        break;
+      }
+    }
+    self.putColumn (columnName, startrow, nrow, rowincr,
+                    pyToValueHolder (value));
+  }
+
+  // The number of bytes copied by the zero-copy converters of this module.
+  Int64 bytesCopied()
+  {
+    return pyBufferBytesCopied();
+  }
+
+  // Get the keywords of the table or a column as a dict.
+  boost::python::dict getKeywordSetDict (TableProxy& self,
+                                         const String& columnName)
+  {
+    RecordConverter converter;
+    return converter.toDict (self.getKeywordSet (columnName));
+  }
+
+  // Get the number of rows in a row range as used by TableProxy.
+  Int rangeRows (const Table& tab, Int startrow, Int nrow, Int rowincr)
+  {
+    Int nrows = tab.nrow();
+    if (startrow < 0  ||  startrow > nrows  ||  rowincr <= 0) {
+      throw AipsError ("Invalid startrow or rowincr given");
+    }
+    Int maxnr = (nrows - startrow + rowincr - 1) / rowincr;
+    return (nrow < 0  ||  nrow > maxnr)  ?  maxnr : nrow;
+  }
+
+  // Pack the bools of each vector along the first axis into bits, the
+  // way numpy.packbits does it along the last numpy axis (big bit order).
+  // The packed vectors are written consecutively starting at out.
+  // It returns the pointer after the last packed byte.
+  uChar* packBools (const Array<Bool>& arr, uChar* out)
+  {
+    Bool deleteIt;
+    const Bool* data = arr.getStorage (deleteIt);
+    const size_t n = arr.shape()[0];
+    const size_t nvec = (n == 0  ?  0 : arr.size() / n);
+    const Bool* in = data;
+    for (size_t v=0; v<nvec; ++v) {
+      size_t k = 0;
+      for (; k+8 <= n; k+=8) {
+        *out++ = (in[k]   << 7) | (in[k+1] << 6) | (in[k+2] << 5) |
+                 (in[k+3] << 4) | (in[k+4] << 3) | (in[k+5] << 2) |
+                 (in[k+6] << 1) |  in[k+7];
+      }
+      if (k < n) {
+        uChar byte = 0;
+        for (uInt bit=7; k<n; ++k, --bit) {
+          byte |= in[k] << bit;
+        }
+        *out++ = byte;
+      }
+      in += n;
+    }
+    arr.freeStorage (data, deleteIt);
+    return out;
+  }
+
+  // Get a boolean column with the values packed into bits along the
+  // last numpy axis (as numpy.packbits(col, axis=-1) would do).
+  // An array column is read in blocks of rows, so only a block is held
+  // unpacked in memory.
+  boost::python::object getColumnPacked (TableProxy& self,
+                                         const String& columnName,
+                                         Int startrow, Int nrow, Int rowincr)
+  {
+    const Table& tab = self.table();
+    const ColumnDesc& cdesc = tab.tableDesc().columnDesc (columnName);
+    if (cdesc.dataType() != TpBool) {
+      throw AipsError ("getcol: packed can only be used for a boolean "
+                       "column; " + columnName + " is not");
+    }
+    nrow = rangeRows (tab, startrow, nrow, rowincr);
+    if (! cdesc.isArray()) {
+      // A scalar column is packed along the rows.
+      Array<Bool> arr (self.getColumn (columnName, startrow, nrow,
+                                       rowincr).asArrayBool());
+      Array<uChar> packed (IPosition(1, (arr.size() + 7) / 8));
+      packBools (arr, packed.data());
+      return arrayToPython (packed);
+    }
+    if (nrow == 0) {
+      // An empty range has the cell shape of the column description
+      // (with empty axes if not fixed), as packbits would give.
+      IPosition packedShape (cdesc.shape());
+      if (packedShape.empty()) {
+        packedShape = IPosition (std::max(1, cdesc.ndim()), 0);
+      }
+      packedShape[0] = (packedShape[0] + 7) / 8;
+      packedShape.append (IPosition(1, 0));
+      Array<uChar> packed (packedShape);
+      return arrayToPython (packed);
+    }
+    // Use blocks of about 4 MB; the first row tells the cell size.
+    TableColumn tcol (tab, columnName);
+    Int64 cellSize = std::max (Int64(1), tcol.shape(startrow).product());
+    Int blockRows = std::max (Int64(1), Int64(4*1024*1024) / cellSize);
+    Array<uChar> packed;
+    uChar* out = 0;
+    IPosition cellShape;
+    for (Int row=0; row<nrow; row+=blockRows) {
+      Int nr = std::min (blockRows, nrow - row);
+      Array<Bool> arr (self.getColumn (columnName, startrow + row*rowincr,
+                                       nr, rowincr).asArrayBool());
+      IPosition shape (arr.shape().getFirst (arr.ndim() - 1));
+      if (row == 0) {
+        cellShape = shape;
+        IPosition packedShape (arr.shape());
+        packedShape[0] = (packedShape[0] + 7) / 8;
+        packedShape[packedShape.size() - 1] = nrow;
+        packed.resize (packedShape);
+        out = packed.data();
+      } else if (! shape.isEqual (cellShape)) {
+        throw AipsError ("getcol: arrays in column " + columnName +
+                         " have different shapes; packed needs equal shapes");
+      }
+      out = packBools (arr, out);
+    }
+    return arrayToPython (packed);
+  }
+
+  // Read the cells of a variable shaped column into one flat array.
+  // Each cell is read directly into its part of the flat array.
+  template<typename T>
+  Array<T> getRaggedValues (const Table& tab, const String& columnName,
+                            Int startrow, Int rowincr,
+                            const std::vector<IPosition>& shapes,
+                            const Vector<Int64>& offsets)
+  {
+    ArrayColumn<T> acol (tab, columnName);
+    Array<T> values (IPosition(1, offsets[offsets.size() - 1]));
+    T* data = values.data();
+    for (uInt i=0; i<shapes.size(); ++i) {
+      if (shapes[i].nelements() > 0  &&  shapes[i].product() > 0) {
+        Array<T> cell (shapes[i], data + offsets[i], SHARE);
+        acol.get (startrow + i*rowincr, cell);
+      }
+    }
+    return values;
+  }
+
+  // Get a variable shaped column as a ragged array: a dict containing
+  // the flat values of all cells, their shapes and the offsets of the cells
+  // in the flat values. Shapes are in numpy axis order; unused leading axes
+  // and the axes of undefined cells are -1.
+  boost::python::dict getVarColumnRagged (TableProxy& self,
+                                          const String& columnName,
+                                          Int startrow, Int nrow,
+                                          Int rowincr)
+  {
+    const Table& tab = self.table();
+    const ColumnDesc& cdesc = tab.tableDesc().columnDesc (columnName);
+    if (! cdesc.isArray()) {
+      throw AipsError ("getvarcol: column " + columnName +
+                       " does not contain arrays");
+    }
+    nrow = rangeRows (tab, startrow, nrow, rowincr);
+    // Get all shapes first, so the flat array can be made in one go.
+    TableColumn tcol (tab, columnName);
+    std::vector<IPosition> shapes(nrow);
+    Vector<Int64> offsets(nrow + 1);
+    offsets[0] = 0;
+    uInt maxndim = 0;
+    for (Int i=0; i<nrow; ++i) {
+      uInt rownr = startrow + i*rowincr;
+      Int64 size = 0;
+      if (tcol.isDefined (rownr)) {
+        shapes[i] = tcol.shape (rownr);
+        maxndim = std::max (maxndim, uInt(shapes[i].nelements()));
+        size = shapes[i].product();
+      }
+      offsets[i+1] = offsets[i] + size;
+    }
+    Matrix<Int64> shapeArr (std::max(maxndim, 1u), nrow, Int64(-1));
+    for (Int i=0; i<nrow; ++i) {
+      uInt nd = shapes[i].nelements();
+      for (uInt j=0; j<nd; ++j) {
+        shapeArr(shapeArr.nrow() - j - 1, i) = shapes[i][j];
+      }
+    }
+    ValueHolder values;
+    switch (cdesc.dataType()) {
+    case TpBool:
+      values = ValueHolder (getRaggedValues<Bool> (tab, columnName, startrow,
+                                                   rowincr, shapes, offsets));
+      break;
+    case TpUChar:
+      values = ValueHolder (getRaggedValues<uChar> (tab, columnName, startrow,
+                                                    rowincr, shapes, offsets));
+      break;
+    case TpShort:
+      values = ValueHolder (getRaggedValues<Short> (tab, columnName, startrow,
+                                                    rowincr, shapes, offsets));
+      break;
+    case TpInt:
+      values = ValueHolder (getRaggedValues<Int> (tab, columnName, startrow,
+                                                  rowincr, shapes, offsets));
+      break;
+    case TpUInt:
+      values = ValueHolder (getRaggedValues<uInt> (tab, columnName, startrow,
+                                                   rowincr, shapes, offsets));
+      break;
+    case TpInt64:
+      values = ValueHolder (getRaggedValues<Int64> (tab, columnName, startrow,
+                                                    rowincr, shapes, offsets));
+      break;
+    case TpFloat:
+      values = ValueHolder (getRaggedValues<Float> (tab, columnName, startrow,
+                                                    rowincr, shapes, offsets));
+      break;
+    case TpDouble:
+      values = ValueHolder (getRaggedValues<Double> (tab, columnName, startrow,
+                                                     rowincr, shapes, offsets));
+      break;
+    case TpComplex:
+      values = ValueHolder (getRaggedValues<Complex> (tab, columnName,
+                                                      startrow, rowincr,
+                                                      shapes, offsets));
+      break;
+    case TpDComplex:
+      values = ValueHolder (getRaggedValues<DComplex> (tab, columnName,
+                                                       startrow, rowincr,
+                                                       shapes, offsets));
+      break;
+    case TpString:
+      values = ValueHolder (getRaggedValues<String> (tab, columnName,
+                                                     startrow, rowincr,
+                                                     shapes, offsets));
+      break;
+    default:
+      throw AipsError ("getvarcol: unsupported data type of column " +
+                       columnName);
+    }
+    boost::python::dict result;
+    result["values"]  = valueHolderToPython (values);
+    result["shapes"]  = arrayToPython (shapeArr);
+    result["offsets"] = arrayToPython (offsets);
+    return result;
+  }
+
+  // Write the cells of a variable shaped column from one flat array.
+  template<typename T>
+  void putRaggedValues (Table& tab, const String& columnName,
+                        Int startrow, Int rowincr, Int nrow,
+                        const Array<T>& values, const Array<Int64>& shapes,
+                        const Array<Int64>& offsets)
+  {
+    ArrayColumn<T> acol (tab, columnName);
+    // Only read from the cells, so the const_cast is safe.
+    T* data = const_cast<T*>(values.data());
+    const Int64* shp = shapes.data();
+    const Int64* off = offsets.data();
+    uInt maxndim = shapes.shape()[0];
+    for (Int i=0; i<nrow; ++i) {
+      // Reverse the numpy axes, skipping the unused ones.
+      IPosition shape;
+      for (Int j=maxndim-1; j>=0; --j) {
+        if (shp[i*maxndim + j] >= 0) {
+          shape.append (IPosition(1, shp[i*maxndim + j]));
+        }
+      }
+      if (shape.nelements() == 0) {
+        continue;                     // undefined cell
+      }
+      if (off[i] < 0  ||  off[i] + shape.product() > Int64(values.size())) {
+        throw AipsError ("putvarcol: cell exceeds the ragged values");
+      }
+      Array<T> cell (shape, data + off[i], SHARE);
+      acol.put (startrow + i*rowincr, cell);
+    }
+  }
+
+  template<typename T>
+  void putRaggedBorrowed (Table& tab, const String& columnName,
+                          Int startrow, Int rowincr, Int nrow,
+                          PyObject* values, const Array<Int64>& shapes,
+                          const Array<Int64>& offsets)
+  {
+    BorrowedArray<T> arr (values);
+    putRaggedValues (tab, columnName, startrow, rowincr, nrow,
+                     arr.array(), shapes, offsets);
+  }
+
+  // Put a ragged array (as returned by getVarColumnRagged) into a
+  // variable shaped column.
+  void putVarColumnRagged (TableProxy& self, const String& columnName,
+                           Int startrow, Int nrow, Int rowincr,
+                           PyObject* values, const ValueHolder& shapes,
+                           const ValueHolder& offsets)
+  {
+    self.reopenRW();
+    Table& tab = self.table();
+    const ColumnDesc& cdesc = tab.tableDesc().columnDesc (columnName);
+    if (! cdesc.isArray()) {
+      throw AipsError ("putvarcol: column " + columnName +
+                       " does not contain arrays");
+    }
+    Array<Int64> shapeArr (shapes.asArrayInt64());
+    Array<Int64> offsetArr (offsets.asArrayInt64());
+    if (shapeArr.ndim() != 2  ||  offsetArr.ndim() != 1) {
+      throw AipsError ("putvarcol: ragged shapes must be 2-dim and "
+                       "offsets 1-dim");
+    }
+    // Make sure the data are contiguous.
+    if (! shapeArr.contiguousStorage()) {
+      shapeArr = shapeArr.copy();
+    }
+    if (! offsetArr.contiguousStorage()) {
+      offsetArr = offsetArr.copy();
+    }
+    nrow = rangeRows (tab, startrow, nrow, rowincr);
+    if (shapeArr.shape()[1] < nrow  ||  Int(offsetArr.size()) < nrow) {
+      throw AipsError ("putvarcol: ragged shapes or offsets have fewer "
+                       "rows than the column range");
+    }
+    switch (cdesc.dataType()) {
+    case TpBool:
+      putRaggedBorrowed<Bool> (tab, columnName, startrow, rowincr, nrow,
+                               values, shapeArr, offsetArr);
+      break;
+    case TpUChar:
+      putRaggedBorrowed<uChar> (tab, columnName, startrow, rowincr, nrow,
+                                values, shapeArr, offsetArr);
+      break;
+    case TpShort:
+      putRaggedBorrowed<Short> (tab, columnName, startrow, rowincr, nrow,
+                                values, shapeArr, offsetArr);
+      break;
+    case TpInt:
+      putRaggedBorrowed<Int> (tab, columnName, startrow, rowincr, nrow,
+                              values, shapeArr, offsetArr);
+      break;
+    case TpUInt:
+      putRaggedBorrowed<uInt> (tab, columnName, startrow, rowincr, nrow,
+                               values, shapeArr, offsetArr);
+      break;
+    case TpInt64:
+      putRaggedBorrowed<Int64> (tab, columnName, startrow, rowincr, nrow,
+                                values, shapeArr, offsetArr);
+      break;
+    case TpFloat:
+      putRaggedBorrowed<Float> (tab, columnName, startrow, rowincr, nrow,
+                                values, shapeArr, offsetArr);
+      break;
+    case TpDouble:
+      putRaggedBorrowed<Double> (tab, columnName, startrow, rowincr, nrow,
+                                 values, shapeArr, offsetArr);
+      break;
+    case TpComplex:
+      putRaggedBorrowed<Complex> (tab, columnName, startrow, rowincr, nrow,
+                                  values, shapeArr, offsetArr);
+      break;
+    case TpDComplex:
+      putRaggedBorrowed<DComplex> (tab, columnName, startrow, rowincr, nrow,
+                                   values, shapeArr, offsetArr);
+      break;
+    case TpString:
+      {
+        ValueHolder vh = boost::python::extract<ValueHolder>
+          (boost::python::object
+           (boost::python::handle<>(boost::python::borrowed(values))));
+        Array<String> strings (vh.asArrayString());
+        if (! strings.contiguousStorage()) {
+          strings = strings.copy();
+        }
+        putRaggedValues (tab, columnName, startrow, rowincr, nrow,
+                         strings, shapeArr, offsetArr);
+      }
+      break;
+    default:
+      throw AipsError ("putvarcol: unsupported data type of column " +
+                       columnName);
+    }
+  }
+
   void pytable()
   {
+    def ("_bytescopied", &bytesCopied);
+
     // Note that all constructors must have a different number of arguments.
     class_<TableProxy> ("Table",
             init<>())
@@ -159,7 +647,12 @@ namespace casacore { namespace python {
 	     boost::python::arg("trc"),
 	     boost::python::arg("inc"),
              boost::python::arg("value")))
-      .def ("_getcol", &TableProxy::getColumn,
+      .def ("_getcol", &getColumnNoCopy,
+	    (boost::python::arg("columnname"),
+	     boost::python::arg("startrow"),
+	     boost::python::arg("nrow"),
+	     boost::python::arg("rowincr")))
+      .def ("_getcolpacked", &getColumnPacked,
 	    (boost::python::arg("columnname"),
 	     boost::python::arg("startrow"),
 	     boost::python::arg("nrow"),
@@ -175,6 +668,11 @@ namespace casacore { namespace python {
 	     boost::python::arg("startrow"),
 	     boost::python::arg("nrow"),
 	     boost::python::arg("rowincr")))
+      .def ("_getvarcolragged", &getVarColumnRagged,
+	    (boost::python::arg("columnname"),
+	     boost::python::arg("startrow"),
+	     boost::python::arg("nrow"),
+	     boost::python::arg("rowincr")))
       .def ("_getcolslice", &TableProxy::getColumnSliceIP,
 	    (boost::python::arg("columnname"),
 	     boost::python::arg("blc"),
@@ -203,7 +701,7 @@ namespace casacore { namespace python {
 	     boost::python::arg("blc"),
 	     boost::python::arg("trc"),
 	     boost::python::arg("inc")))
-      .def ("_putcol", &TableProxy::putColumn,
+      .def ("_putcol", &putColumnNoCopy,
 	    (boost::python::arg("columnname"),
 	     boost::python::arg("startrow"),
 	     boost::python::arg("nrow"),
@@ -215,6 +713,14 @@ namespace casacore { namespace python {
 	     boost::python::arg("nrow"),
 	     boost::python::arg("rowincr"),
 	     boost::python::arg("value")))
+      .def ("_putvarcolragged", &putVarColumnRagged,
+	    (boost::python::arg("columnname"),
+	     boost::python::arg("startrow"),
+	     boost::python::arg("nrow"),
+	     boost::python::arg("rowincr"),
+	     boost::python::arg("values"),
+	     boost::python::arg("shapes"),
+	     boost::python::arg("offsets")))
       .def ("_putcolslice", &TableProxy::putColumnSliceIP,
 	    (boost::python::arg("columnname"),
 	     boost::python::arg("value"),
@@ -234,7 +740,7 @@ namespace casacore { namespace python {
 	    (boost::python::arg("columnname"),
 	     boost::python::arg("keyword"),
 	     boost::python::arg("keywordindex")))
-      .def ("_getkeywords", &TableProxy::getKeywordSet,
+      .def ("_getkeywords", &getKeywordSetDict,
 	    (boost::python::arg("columnname")))
       .def ("_putkeyword", &TableProxy::putKeyword,
 	    (boost::python::arg("columnname"),
@@ -253,7 +759,7 @@ namespace casacore { namespace python {
 	    (boost::python::arg("columnname"),
 	     boost::python::arg("keyword"),
 	     boost::python::arg("keywordindex")))
-      .def ("_getdminfo", &TableProxy::getDataManagerInfo)
+      .def ("_getdminfo", &getDataManagerInfoDict)
       .def ("_getdmprop", &TableProxy::getProperties,
 	    (boost::python::arg("name"),
 	     boost::python::arg("bycolumn")))
@@ -261,10 +767,10 @@ namespace casacore { namespace python {
 	    (boost::python::arg("name"),
              boost::python::arg("properties"),
 	     boost::python::arg("bycolumn")))
-      .def ("_getdesc", &TableProxy::getTableDescription,
+      .def ("_getdesc", &getTableDescDict,
 	    (boost::python::arg("actual"),
 	     boost::python::arg("_cOrder")=true))
-      .def ("_getcoldesc", &TableProxy::getColumnDescription,
+      .def ("_getcoldesc", &getColumnDescDict,
 	    (boost::python::arg("columnname"),
  	     boost::python::arg("actual"),
 	     boost::python::arg("_cOrder")=true))
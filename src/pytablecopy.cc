@@ -0,0 +1,429 @@
+//# pytablecopy.cc: copy a table while reading and writing concurrently
+//# Copyright (C) 2017
+//# Associated Universities, Inc. Washington DC, USA.
+//#
+//# This library is free software; you can redistribute it and/or modify it
+//# under the terms of the GNU Library General Public License as published by
+//# the Free Software Foundation; either version 2 of the License, or (at your
+//# option) any later version.
+//#
+//# This library is distributed in the hope that it will be useful, but WITHOUT
+//# ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//# FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+//# License for more details.
+//#
+//# You should have received a copy of the GNU Library General Public License
+//# along with this library; if not, write to the Free Software Foundation,
+//# Inc., 675 Massachusetts Ave, Cambridge, MA 02139, USA.
+//#
+//# Correspondence concerning AIPS++ should be addressed as follows:
+//#        Internet email: aips2-request@nrao.edu.
+//#        Postal address: AIPS++ Project Office
+//#                        National Radio Astronomy Observatory
+//#                        520 Edgemont Road
+//#                        Charlottesville, VA 22903-2475 USA
+//#
+//# $Id: $
+
+
+#include "tables.h"
+#include "pygil.h"
+
+#include <casacore/tables/Tables/TableProxy.h>
+#include <casacore/tables/Tables/TableCopy.h>
+#include <casacore/tables/Tables/TableDesc.h>
+#include <casacore/tables/Tables/ColumnDesc.h>
+#include <casacore/tables/Tables/TableRecord.h>
+#include <casacore/tables/Tables/ScalarColumn.h>
+#include <casacore/tables/Tables/ArrayColumn.h>
+#include <casacore/casa/Arrays/Slicer.h>
+#include <casacore/casa/Containers/Record.h>
+#include <casacore/casa/Exceptions/Error.h>
+#include <casacore/python/Converters/PycBasicData.h>
+#include <casacore/python/Converters/PycRecord.h>
+
+#include <boost/python.hpp>
+#include <boost/python/args.hpp>
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace boost::python;
+
+namespace casacore { namespace python {
+
+  // The data of a block of rows of a column.
+  struct ColumnData
+  {
+    ColumnData()
+      : nbytes (0)
+    {}
+    virtual ~ColumnData()
+      {}
+    // The size of the data read.
+    size_t nbytes;
+  };
+
+  template<typename T>
+  struct ColumnDataT : public ColumnData
+  {
+    // The values of all rows if they could be read in one go.
+    Array<T>              all;
+    Bool                  hasAll;
+    // Otherwise the values of each cell (undefined cells are not copied).
+    std::vector<Array<T> > cells;
+    std::vector<Bool>     defined;
+  };
+
+  // Copy a column in blocks of rows.
+  // read is only used for the input table and write for the output table,
+  // so they can be done in different threads.
+  class ColumnCopier
+  {
+  public:
+    virtual ~ColumnCopier()
+      {}
+    // Estimate the number of bytes per row.
+    virtual size_t rowBytes() const = 0;
+    // Read the data of a block of rows and set its size.
+    virtual std::shared_ptr<ColumnData> read (uInt startrow, uInt nrow) = 0;
+    virtual void write (const ColumnData& data, uInt startrow, uInt nrow) = 0;
+  };
+
+  template<typename T>
+  class ScalarCopier : public ColumnCopier
+  {
+  public:
+    ScalarCopier (const Table& in, const Table& out, const String& name)
+      : itsIn  (in, name),
+        itsOut (out, name)
+    {}
+    virtual size_t rowBytes() const
+      { return sizeof(T); }
+    virtual std::shared_ptr<ColumnData> read (uInt startrow, uInt nrow)
+    {
+      std::shared_ptr<ColumnDataT<T> > data (new ColumnDataT<T>());
+      data->all.reference (itsIn.getColumnRange
+                           (Slicer(IPosition(1, startrow), IPosition(1, nrow))));
+      data->hasAll = True;
+      data->nbytes = data->all.size() * sizeof(T);
+      return data;
+    }
+    virtual void write (const ColumnData& data, uInt startrow, uInt nrow)
+    {
+      const ColumnDataT<T>& d = static_cast<const ColumnDataT<T>&>(data);
+      itsOut.putColumnRange (Slicer(IPosition(1, startrow), IPosition(1, nrow)),
+                             Vector<T>(d.all));
+    }
+  private:
+    ScalarColumn<T> itsIn;
+    ScalarColumn<T> itsOut;
+  };
+
+  template<typename T>
+  class ArrayCopier : public ColumnCopier
+  {
+  public:
+    ArrayCopier (const Table& in, const Table& out, const String& name)
+      : itsIn  (in, name),
+        itsOut (out, name)
+    {}
+    // The shapes can vary, so use the largest of a few cells spread over
+    // the table. Blocks that are larger nevertheless are handled by
+    // copyDataPipelined.
+    virtual size_t rowBytes() const
+    {
+      const uInt nsample = 16;
+      const uInt nrow = itsIn.nrow();
+      const uInt step = std::max (1u, nrow / nsample);
+      size_t nbytes = sizeof(T);
+      for (uInt row=0; row<nrow; row+=step) {
+        if (itsIn.isDefined(row)) {
+          nbytes = std::max (nbytes,
+                             size_t(sizeof(T) * itsIn.shape(row).product()));
+        }
+      }
+      return nbytes;
+    }
+    virtual std::shared_ptr<ColumnData> read (uInt startrow, uInt nrow)
+    {
+      std::shared_ptr<ColumnDataT<T> > data (new ColumnDataT<T>());
+      data->hasAll = False;
+      try {
+        // This fails if the shapes differ or cells are undefined.
+        data->all.reference (itsIn.getColumnRange
+                             (Slicer(IPosition(1, startrow),
+                                     IPosition(1, nrow))));
+        data->hasAll = True;
+        data->nbytes = data->all.size() * sizeof(T);
+      } catch (const AipsError&) {
+        data->cells.resize (nrow);
+        data->defined.resize (nrow);
+        for (uInt i=0; i<nrow; ++i) {
+          data->defined[i] = itsIn.isDefined (startrow + i);
+          if (data->defined[i]) {
+            data->cells[i].reference (itsIn(startrow + i));
+            data->nbytes += data->cells[i].size() * sizeof(T);
+          }
+        }
+      }
+      return data;
+    }
+    virtual void write (const ColumnData& data, uInt startrow, uInt nrow)
+    {
+      const ColumnDataT<T>& d = static_cast<const ColumnDataT<T>&>(data);
+      if (d.hasAll) {
+        itsOut.putColumnRange (Slicer(IPosition(1, startrow),
+                                      IPosition(1, nrow)), d.all);
+      } else {
+        for (uInt i=0; i<nrow; ++i) {
+          if (d.defined[i]) {
+            itsOut.put (startrow + i, d.cells[i]);
+          }
+        }
+      }
+    }
+  private:
+    ArrayColumn<T> itsIn;
+    ArrayColumn<T> itsOut;
+  };
+
+  template<typename T>
+  ColumnCopier* makeCopier (const Table& in, const Table& out,
+                            const String& name, Bool isArray)
+  {
+    if (isArray) {
+      return new ArrayCopier<T> (in, out, name);
+    }
+    return new ScalarCopier<T> (in, out, name);
+  }
+
+  // Make the copier for a column; 0 is returned for an unsupported type.
+  ColumnCopier* makeCopier (const Table& in, const Table& out,
+                            const ColumnDesc& cdesc)
+  {
+    const String& name = cdesc.name();
+    Bool isArray = cdesc.isArray();
+    switch (cdesc.dataType()) {
+    case TpBool:
+      return makeCopier<Bool> (in, out, name, isArray);
+    case TpUChar:
+      return makeCopier<uChar> (in, out, name, isArray);
+    case TpShort:
+      return makeCopier<Short> (in, out, name, isArray);
+    case TpUShort:
+      return makeCopier<uShort> (in, out, name, isArray);
+    case TpInt:
+      return makeCopier<Int> (in, out, name, isArray);
+    case TpUInt:
+      return makeCopier<uInt> (in, out, name, isArray);
+    case TpInt64:
+      return makeCopier<Int64> (in, out, name, isArray);
+    case TpFloat:
+      return makeCopier<Float> (in, out, name, isArray);
+    case TpDouble:
+      return makeCopier<Double> (in, out, name, isArray);
+    case TpComplex:
+      return makeCopier<Complex> (in, out, name, isArray);
+    case TpDComplex:
+      return makeCopier<DComplex> (in, out, name, isArray);
+    case TpString:
+      return makeCopier<String> (in, out, name, isArray);
+    case TpRecord:
+      if (! isArray) {
+        return new ScalarCopier<TableRecord> (in, out, name);
+      }
+      break;
+    default:
+      break;
+    }
+    return 0;
+  }
+
+  // A block of rows read from all columns.
+  struct CopyBlock
+  {
+    uInt   startrow;
+    uInt   nrow;
+    size_t nbytes;
+    std::vector<std::shared_ptr<ColumnData> > data;
+  };
+
+  // Copy the data of all columns from the input to the output table,
+  // which must have the same number of rows.
+  // A thread reads blocks of rows (of about 64 MB) from the input table,
+  // while the calling thread writes them into the output table. At most
+  // nahead blocks are read ahead and they hold at most 256 MB together
+  // (unless a single block is larger). The number of rows per block is
+  // estimated from a few rows and made smaller if a block turns out to be
+  // too large. Casacore tables cannot be accessed by multiple threads,
+  // but each table is only used by one thread here.
+  void copyDataPipelined (const Table& in, Table& out, uInt nahead)
+  {
+    const size_t blockBytes = 64*1024*1024;
+    const size_t aheadBytes = 256*1024*1024;
+    const TableDesc& tdesc = out.tableDesc();
+    std::vector<std::shared_ptr<ColumnCopier> > copiers;
+    size_t rowBytes = 0;
+    for (uInt i=0; i<tdesc.ncolumn(); ++i) {
+      const ColumnDesc& cdesc = tdesc.columnDesc(i);
+      // Only copy the writable columns that exist in the input.
+      if (! in.tableDesc().isColumn (cdesc.name())  ||
+          ! out.isColumnWritable (cdesc.name())) {
+        continue;
+      }
+      ColumnCopier* copier = makeCopier (in, out, cdesc);
+      if (copier == 0) {
+        // Copy everything in the normal way.
+        TableCopy::copyRows (out, in);
+        return;
+      }
+      copiers.push_back (std::shared_ptr<ColumnCopier>(copier));
+      rowBytes += copier->rowBytes();
+    }
+    const uInt nrow = in.nrow();
+    uInt blockRows = std::max (size_t(1),
+                               blockBytes / std::max(size_t(1), rowBytes));
+    std::deque<CopyBlock> queue;
+    size_t queueBytes = 0;
+    std::mutex mutex;
+    std::condition_variable changed;
+    Bool readDone = False;
+    Bool abort    = False;
+    std::exception_ptr readError;
+    std::thread reader ([&] () {
+      try {
+        uInt row = 0;
+        while (row < nrow) {
+          CopyBlock block;
+          block.startrow = row;
+          block.nrow     = std::min (blockRows, nrow - row);
+          block.nbytes   = 0;
+          for (size_t i=0; i<copiers.size(); ++i) {
+            block.data.push_back (copiers[i]->read (block.startrow,
+                                                    block.nrow));
+            block.nbytes += block.data.back()->nbytes;
+          }
+          row += block.nrow;
+          // Use fewer rows for the next blocks if this one was too large.
+          if (block.nbytes > 2 * blockBytes) {
+            blockRows = uInt(std::max (size_t(1),
+                                       size_t(block.nrow) * blockBytes /
+                                       block.nbytes));
+          }
+          std::unique_lock<std::mutex> lock(mutex);
+          changed.wait (lock, [&] () {
+              return abort  ||  queue.empty()  ||
+                (queue.size() < nahead  &&
+                 queueBytes + block.nbytes <= aheadBytes);});
+          if (abort) {
+            break;
+          }
+          queueBytes += block.nbytes;
+          queue.push_back (block);
+          changed.notify_all();
+        }
+      } catch (...) {
+        readError = std::current_exception();
+      }
+      std::lock_guard<std::mutex> lock(mutex);
+      readDone = True;
+      changed.notify_all();
+    });
+    try {
+      while (True) {
+        CopyBlock block;
+        {
+          std::unique_lock<std::mutex> lock(mutex);
+          changed.wait (lock, [&] () {return readDone || !queue.empty();});
+          if (queue.empty()) {
+            break;
+          }
+          block = queue.front();
+          queue.pop_front();
+          queueBytes -= block.nbytes;
+          changed.notify_all();
+        }
+        for (size_t i=0; i<copiers.size(); ++i) {
+          copiers[i]->write (*block.data[i], block.startrow, block.nrow);
+        }
+      }
+    } catch (...) {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        abort = True;
+        changed.notify_all();
+      }
+      reader.join();
+      throw;
+    }
+    reader.join();
+    if (readError) {
+      std::rethrow_exception (readError);
+    }
+  }
+
+  Table::EndianFormat endianFormat (const String& endian)
+  {
+    String str(endian);
+    str.downcase();
+    if (str == "big") {
+      return Table::BigEndian;
+    } else if (str == "little") {
+      return Table::LittleEndian;
+    } else if (str == "local") {
+      return Table::LocalEndian;
+    } else if (str == "aipsrc") {
+      return Table::AipsrcEndian;
+    }
+    throw AipsError ("Invalid endian format " + endian +
+                     " (must be big, little, local or aipsrc)");
+  }
+
+  // Make a deep copy of a table (as TableProxy::copy with valuecopy=True)
+  // where the data are read and written concurrently (see
+  // copyDataPipelined); up to readAhead blocks are read ahead.
+  // The dminfo can change the data managers of the new table.
+  // The input table is held, so it stays valid if another Python thread
+  // closes the table object while the GIL is released.
+  TableProxy copyTablePipelined (TableProxy& self,
+                                 const String& newTableName,
+                                 Bool memoryTable, const String& endian,
+                                 const Record& dminfo, Int readAhead)
+  {
+    Table in = self.table();
+    Table::EndianFormat endianFmt = endianFormat (endian);
+    uInt nahead = std::max (1, readAhead);
+    Table out;
+    {
+      ReleaseGIL release;
+      if (memoryTable) {
+        out = TableCopy::makeEmptyMemoryTable (newTableName, in, False);
+      } else {
+        out = TableCopy::makeEmptyTable (newTableName, dminfo, in,
+                                         Table::New, endianFmt, True, False);
+      }
+      copyDataPipelined (in, out, nahead);
+      TableCopy::copyInfo (out, in);
+      TableCopy::copySubTables (out, in);
+    }
+    return TableProxy(out);
+  }
+
+  void pytablecopy()
+  {
+    def ("_copy_pipelined", &copyTablePipelined,
+         (boost::python::arg("table"),
+          boost::python::arg("newtablename"),
+          boost::python::arg("memorytable"),
+          boost::python::arg("endian"),
+          boost::python::arg("dminfo"),
+          boost::python::arg("readahead")));
+  }
+
+}}
@@ -25,25 +25,298 @@
 //#
 //# $Id: pytablerow.cc,v 1.2 2006/10/25 22:14:54 gvandiep Exp $
 
+#include "pyrecord.h"
+
 #include <casacore/tables/Tables/TableRowProxy.h>
 #include <casacore/tables/Tables/TableProxy.h>
+#include <casacore/tables/Tables/TableRow.h>
+#include <casacore/tables/Tables/TableColumn.h>
+#include <casacore/tables/Tables/TableDesc.h>
+#include <casacore/tables/Tables/ColumnDesc.h>
+#include <casacore/casa/Utilities/DataType.h>
+#include <casacore/casa/Exceptions/Error.h>
 #include <casacore/python/Converters/PycBasicData.h>
 #include <casacore/python/Converters/PycRecord.h>
 #include <boost/python.hpp>
 #include <boost/python/args.hpp>
 
+#include <algorithm>
+
 using namespace boost::python;
 
 namespace casacore { namespace python {
 
+  // The row object used in Python. Besides the TableRowProxy it keeps the
+  // table and the row description, so a range of rows can be read by
+  // column.
+  class PyTableRow : public TableRowProxy
+  {
+  public:
+    PyTableRow (const TableProxy& table, const Vector<String>& columnNames,
+                Bool exclude)
+      : TableRowProxy (table, columnNames, exclude),
+        itsTable      (table)
+    {
+      // Make the description once in the same way as TableRowProxy does;
+      // only writable columns are used for a writable table.
+      const Table& tab = itsTable.table();
+      if (itsTable.isWritable()) {
+        itsDesc = TableRow(tab, columnNames, exclude).record().description();
+      } else {
+        itsDesc = ROTableRow(tab, columnNames, exclude).record().description();
+      }
+    }
+
+    TableProxy& table()
+      { return itsTable; }
+
+    const RecordDesc& description() const
+      { return itsDesc; }
+
+  private:
+    TableProxy itsTable;
+    RecordDesc itsDesc;
+  };
+
+  // Convert rows to dicts, keeping the conversion plan between rows.
+  class RowConverter
+  {
+  public:
+    RowConverter()
+      : itsConverter (new RecordConverter())
+    {}
+
+    boost::python::dict get (const PyTableRow& row, Int rownr)
+      { return itsConverter->toDict (row.get (rownr)); }
+
+    LazyRecord getLazy (const PyTableRow& row, Int rownr)
+      { return LazyRecord (row.get (rownr), itsConverter); }
+
+  private:
+    std::shared_ptr<RecordConverter> itsConverter;
+  };
+
+  // Get the numpy type code of the (scalar or array) data type.
+  // The length of a string type has to be appended.
+  String numpyTypeCode (DataType dtype)
+  {
+    switch (asScalar(dtype)) {
+    case TpBool:
+      return "?";
+    case TpUChar:
+      return "u1";
+    case TpShort:
+      return "i2";
+    case TpUShort:
+      return "u2";
+    case TpInt:
+      return "i4";
+    case TpUInt:
+      return "u4";
+    case TpInt64:
+      return "i8";
+    case TpFloat:
+      return "f4";
+    case TpDouble:
+      return "f8";
+    case TpComplex:
+      return "c8";
+    case TpDComplex:
+      return "c16";
+    case TpString:
+      return "U";
+    default:
+      break;
+    }
+    throw AipsError ("tablerow.get_range: data type " +
+                     String::toString(dtype) + " cannot be put in a numpy "
+                     "structured array");
+  }
+
+  // Get the number of characters in a UTF-8 string.
+  size_t utf8Length (const String& str)
+  {
+    size_t n = 0;
+    for (String::const_iterator iter=str.begin(); iter!=str.end(); ++iter) {
+      // Do not count continuation bytes.
+      if ((static_cast<unsigned char>(*iter) & 0xC0) != 0x80) {
+        ++n;
+      }
+    }
+    return n;
+  }
+
+  // Decode a UTF-8 string into UCS4 characters (as numpy stores them).
+  // Each character counted by utf8Length gives one code; an invalid or
+  // truncated sequence gives the replacement character.
+  void utf8ToUcs4 (const String& str, uInt* out)
+  {
+    const unsigned char* data =
+      reinterpret_cast<const unsigned char*>(str.data());
+    size_t n = str.size();
+    size_t i = 0;
+    while (i < n) {
+      unsigned char c = data[i++];
+      if ((c & 0xC0) == 0x80) {
+        continue;                     // stray continuation byte
+      }
+      int ncont;
+      uInt code;
+      if (c < 0x80) {
+        ncont = 0; code = c;
+      } else if ((c & 0xE0) == 0xC0) {
+        ncont = 1; code = c & 0x1F;
+      } else if ((c & 0xF0) == 0xE0) {
+        ncont = 2; code = c & 0x0F;
+      } else if ((c & 0xF8) == 0xF0) {
+        ncont = 3; code = c & 0x07;
+      } else {
+        ncont = -1; code = 0xFFFD;
+      }
+      for (int j=0; j<ncont; ++j) {
+        if (i == n  ||  (data[i] & 0xC0) != 0x80) {
+          code = 0xFFFD;
+          break;
+        }
+        code = (code << 6) | (data[i++] & 0x3F);
+      }
+      *out++ = code;
+    }
+  }
+
+  // Get a range of rows as a numpy structured array.
+  // Each column of the row object is a field; an array column must have
+  // the same shape in all rows and becomes a subarray field.
+  // The columns are read as a whole and copied into the fields.
+  boost::python::object getRowRange (PyTableRow& self,
+                                     Int startrow, Int nrow)
+  {
+    TableProxy& table = self.table();
+    Int nrows = table.nrows();
+    if (startrow < 0  ||  startrow > nrows) {
+      throw AipsError ("tablerow.get_range: startrow " +
+                       String::toString(startrow) + " exceeds the table");
+    }
+    if (nrow < 0  ||  nrow > nrows - startrow) {
+      nrow = nrows - startrow;
+    }
+    const Table& tab = table.table();
+    const RecordDesc& desc = self.description();
+    const uInt nf = desc.nfields();
+    std::vector<ValueHolder> values(nf);
+    std::vector<size_t> lengths(nf, 0);
+    std::vector<boost::python::tuple> shapes(nf);
+    boost::python::list dtype;
+    for (uInt i=0; i<nf; ++i) {
+      const String& name = desc.name(i);
+      String code = numpyTypeCode (desc.type(i));
+      if (nrow > 0) {
+        values[i] = table.getColumn (name, startrow, nrow, 1);
+      }
+      if (asScalar(desc.type(i)) == TpString) {
+        size_t maxlen = 1;
+        if (nrow > 0) {
+          const Array<String>& arr = values[i].asArrayString();
+          for (Array<String>::const_iterator iter=arr.begin();
+               iter!=arr.end(); ++iter) {
+            maxlen = std::max (maxlen, utf8Length(*iter));
+          }
+        }
+        lengths[i] = maxlen;
+        code += String::toString(maxlen);
+      }
+      // Axes are in reversed order in numpy.
+      boost::python::list shape;
+      shape.append (nrow);
+      if (isArray(desc.type(i))) {
+        // The shape of the first cell; if the range is empty it is taken
+        // from the column description.
+        IPosition cellShape;
+        if (nrow > 0) {
+          cellShape = TableColumn(tab, name).shape (startrow);
+        } else {
+          const ColumnDesc& cdesc = tab.tableDesc().columnDesc(name);
+          cellShape = cdesc.shape();
+          if (cellShape.empty()) {
+            cellShape = IPosition(std::max(1, cdesc.ndim()), 0);
+          }
+        }
+        boost::python::list cellAxes;
+        for (Int j=cellShape.size()-1; j>=0; --j) {
+          cellAxes.append (cellShape[j]);
+        }
+        shape.extend (cellAxes);
+        dtype.append (boost::python::make_tuple
+                      (boost::python::str(name), code,
+                       boost::python::tuple(cellAxes)));
+      } else {
+        dtype.append (boost::python::make_tuple
+                      (boost::python::str(name), code));
+      }
+      shapes[i] = boost::python::tuple(shape);
+    }
+    boost::python::object numpy = boost::python::import("numpy");
+    boost::python::object result = numpy.attr("empty") (nrow, dtype);
+    if (nrow > 0) {
+      for (uInt i=0; i<nf; ++i) {
+        boost::python::object column;
+        if (asScalar(desc.type(i)) == TpString) {
+          // Fill the UCS4 characters of all strings in one buffer, which
+          // numpy views as fixed-width strings. Storage order of the
+          // casacore array is numpy's C order.
+          const Array<String>& arr = values[i].asArrayString();
+          const size_t maxlen = lengths[i];
+          Array<uInt> chars (IPosition(2, maxlen, arr.size()), 0u);
+          uInt* out = chars.data();
+          for (Array<String>::const_iterator iter=arr.begin();
+               iter!=arr.end(); ++iter) {
+            utf8ToUcs4 (*iter, out);
+            out += maxlen;
+          }
+          column = arrayToPython (chars).attr("view")
+            ("U" + String::toString(maxlen)).attr("reshape")(shapes[i]);
+        } else {
+          column = valueHolderToPython (values[i]);
+        }
+        result[boost::python::str(desc.name(i))] = column;
+        // Release the column data as soon as it is copied.
+        values[i] = ValueHolder();
+      }
+    }
+    return result;
+  }
+
   void pytablerow()
   {
-    class_<TableRowProxy> ("TableRow",
+    class_<RowConverter> ("RowConverter",
+            init<>())
+      .def ("_get", &RowConverter::get,
+	    (boost::python::arg("row"),
+	     boost::python::arg("rownr")))
+      .def ("_getlazy", &RowConverter::getLazy,
+	    (boost::python::arg("row"),
+	     boost::python::arg("rownr")))
+      ;
+
+    class_<LazyRecord> ("LazyRecord", no_init)
+      .def ("keys", &LazyRecord::keys)
+      .def ("__len__", &LazyRecord::size)
+      .def ("__contains__", &LazyRecord::contains,
+	    (boost::python::arg("key")))
+      .def ("_get", &LazyRecord::get,
+	    (boost::python::arg("key")))
+      .def ("_todict", &LazyRecord::toDict)
+      ;
+
+    class_<PyTableRow> ("TableRow",
 	    init<TableProxy, Vector<String>, Bool>())
 
       .def ("_iswritable", &TableRowProxy::isWritable)
       .def ("_get", &TableRowProxy::get,
 	    (boost::python::arg("rownr")))
+      .def ("_getrange", &getRowRange,
+	    (boost::python::arg("startrow"),
+	     boost::python::arg("nrow")))
       .def ("_put", &TableRowProxy::put,
 	    (boost::python::arg("rownr"),
 	     boost::python::arg("value"),
@@ -0,0 +1,86 @@
+//# pythreads.h: run a loop over items in parallel threads
+//# Copyright (C) 2017
+//# Associated Universities, Inc. Washington DC, USA.
+//#
+//# This library is free software; you can redistribute it and/or modify it
+//# under the terms of the GNU Library General Public License as published by
+//# the Free Software Foundation; either version 2 of the License, or (at your
+//# option) any later version.
+//#
+//# This library is distributed in the hope that it will be useful, but WITHOUT
+//# ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//# FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+//# License for more details.
+//#
+//# You should have received a copy of the GNU Library General Public License
+//# along with this library; if not, write to the Free Software Foundation,
+//# Inc., 675 Massachusetts Ave, Cambridge, MA 02139, USA.
+//#
+//# Correspondence concerning AIPS++ should be addressed as follows:
+//#        Internet email: aips2-request@nrao.edu.
+//#        Postal address: AIPS++ Project Office
+//#                        National Radio Astronomy Observatory
+//#                        520 Edgemont Road
+//#                        Charlottesville, VA 22903-2475 USA
+//#
+//# $Id: $
+
+#ifndef PYRAP_PYTHREADS_H
+#define PYRAP_PYTHREADS_H
+
+#include <casacore/casa/aips.h>
+
+#include <algorithm>
+#include <exception>
+#include <thread>
+#include <vector>
+
+namespace casacore {
+  namespace python {
+
+    // Get the number of threads to use for n items (0 means all cores).
+    inline uInt nrThreads (uInt nthreads, size_t n)
+    {
+      if (nthreads == 0) {
+        nthreads = std::max (1u, std::thread::hardware_concurrency());
+      }
+      if (nthreads > n) {
+        nthreads = n;
+      }
+      return nthreads;
+    }
+
+    // Run func(thread, start, end) in nthreads threads, each for a
+    // contiguous part of n items. An exception thrown in a thread is
+    // rethrown after all threads have finished.
+    template<typename FUNC>
+    void runParts (size_t n, uInt nthreads, const FUNC& func)
+    {
+      std::vector<std::thread> threads;
+      std::vector<std::exception_ptr> errors (nthreads);
+      size_t chunk = (n + nthreads - 1) / nthreads;
+      for (uInt i=0; i<nthreads; ++i) {
+        size_t st  = std::min (n, i*chunk);
+        size_t end = std::min (n, st+chunk);
+        threads.push_back (std::thread ([&, i, st, end] () {
+          try {
+            func (i, st, end);
+          } catch (...) {
+            errors[i] = std::current_exception();
+          }
+        }));
+      }
+      for (uInt i=0; i<nthreads; ++i) {
+        threads[i].join();
+      }
+      for (uInt i=0; i<nthreads; ++i) {
+        if (errors[i]) {
+          std::rethrow_exception (errors[i]);
+        }
+      }
+    }
+
+  } // python
+} //casa
+
+#endif
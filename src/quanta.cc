@@ -30,6 +30,7 @@
 #include <casacore/python/Converters/PycExcp.h>
 #include <casacore/python/Converters/PycBasicData.h>
 #include <casacore/python/Converters/PycRecord.h>
+#include <casacore/python/Converters/PycValueHolder.h>
 
 #include <boost/python.hpp>
 
@@ -38,6 +39,7 @@ BOOST_PYTHON_MODULE(_quanta)
   casa::python::register_convert_excp();
   casa::python::register_convert_basicdata();
   casa::python::register_convert_casa_record();
+  casa::python::register_convert_casa_valueholder();
 
   casa::python::quantity();
   casa::python::quantvec();
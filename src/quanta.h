@@ -29,9 +29,78 @@
 #define PYRAP_QUANTA_H
 
 #include <casacore/casa/aips.h>
+#include <casacore/casa/Quanta/Quantum.h>
+#include <casacore/casa/Quanta/Unit.h>
+#include <casacore/casa/Quanta/UnitVal.h>
+#include <casacore/casa/BasicSL/String.h>
 
 namespace casacore {
   namespace python {
+    // Clear the unit cache if the user-defined or customary units changed
+    // since the last call. It must be called once by each function using
+    // cachedUnit, before using it.
+    void checkUnitCache();
+    // Get the parsed unit of a unit string.
+    // The parsed units are kept in a small LRU cache, so repeated use of
+    // the same unit string does not parse it again.
+    Unit cachedUnit (const String& unit);
+    // Get the canonical (SI) unit string of a unit value.
+    String canonicalUnit (const UnitVal& val);
+    // Get the factor to convert values from one unit to another.
+    // An exception is thrown if the units do not conform.
+    Double unitFactor (const String& from, const String& to);
+
+    // Functions for scalar and vector quanta using the unit cache.
+    // <group>
+    // Get the quantum in the given unit (also converting between angle
+    // and time like Quantum::get).
+    template<typename T>
+    Quantum<T> quantumGet (const Quantum<T>& q, const String& u)
+    {
+      checkUnitCache();
+      return q.get (cachedUnit(u));
+    }
+    // Get the value in the given unit. The cached unit factor is used
+    // if the units conform; otherwise Quantum::getValue does it, which
+    // also converts between angle and time.
+    template<typename T>
+    T quantumGetValue (const Quantum<T>& q, const String& u)
+    {
+      checkUnitCache();
+      Unit unit = cachedUnit(u);
+      const UnitVal& fromVal = q.getFullUnit().getValue();
+      const UnitVal& toVal = unit.getValue();
+      if (fromVal == toVal) {
+        T values = q.getValue() * (fromVal.getFac() / toVal.getFac());
+        return values;
+      }
+      return q.getValue (unit);
+    }
+    // Get the quantum in canonical units.
+    template<typename T>
+    Quantum<T> quantumCanonical (const Quantum<T>& q)
+    {
+      checkUnitCache();
+      const UnitVal& val = q.getFullUnit().getValue();
+      T values = q.getValue() * val.getFac();
+      return Quantum<T> (values, cachedUnit (canonicalUnit (val)));
+    }
+    // Convert the quantum to the given unit.
+    template<typename T>
+    void quantumConvert (Quantum<T>& q, const String& u)
+    {
+      checkUnitCache();
+      q.convert (cachedUnit(u));
+    }
+    // Tell if the quantum conforms to the given unit.
+    template<typename T>
+    bool quantumConforms (const Quantum<T>& q, const String& u)
+    {
+      checkUnitCache();
+      return q.getFullUnit().getValue() == cachedUnit(u).getValue();
+    }
+    // </group>
+
     void quantity();
     void quantvec();
     void quantamath();
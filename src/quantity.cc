@@ -25,13 +25,18 @@
 //#
 //# $Id:$
 
+#include "quanta.h"
+
 #include <casacore/casa/Quanta.h>
 #include <casacore/casa/Quanta/QLogical.h>
 #include <casacore/casa/Quanta/QuantumHolder.h>
+#include <casacore/casa/Quanta/UnitMap.h>
 #include <casacore/casa/Quanta/MVTime.h>
 #include <casacore/casa/Quanta/MVAngle.h>
 
 #include <casacore/casa/Containers/Record.h>
+#include <casacore/casa/Containers/ValueHolder.h>
+#include <casacore/casa/Arrays/Array.h>
 #include <casacore/casa/Exceptions/Error.h>
 #include <casacore/casa/sstream.h>
 #include <casacore/casa/BasicSL/String.h>
@@ -40,12 +45,107 @@
 #include <boost/python/args.hpp>
 #include <boost/python/overloads.hpp>
 
+#include <list>
+#include <map>
+#include <utility>
+
 using namespace boost::python;
 
 
 namespace casacore {
   namespace python {
 
+  // The cache of parsed units. The list holds the unit strings in order
+  // of use (most recent first); the map gives the unit and list position.
+  // It is only used from functions called with the GIL held, so it needs
+  // no lock.
+  // A parsed unit depends on the user-defined and customary units, so the
+  // cache is cleared by checkUnitCache when those are changed (e.g. by
+  // UnitMap::putUser or UnitMap::addFITS).
+  namespace {
+    const size_t theirUnitCacheSize = 256;
+    typedef std::list<String> UnitCacheList;
+    typedef std::map<String, std::pair<Unit, UnitCacheList::iterator> >
+      UnitCacheMap;
+    typedef std::map<String, std::pair<Double, UnitVal> > UnitDefMap;
+    UnitCacheList theirUnitCacheList;
+    UnitCacheMap  theirUnitCacheMap;
+    UnitDefMap    theirUserUnits;
+    size_t        theirNrCustUnits = 0;
+  }
+
+  void checkUnitCache() {
+    const map<String, UnitName>& user = UnitMap::giveUser();
+    size_t nrCust = UnitMap::giveCust().size();
+    Bool changed = (nrCust != theirNrCustUnits  ||
+                    user.size() != theirUserUnits.size());
+    if (!changed) {
+      UnitDefMap::const_iterator defIter = theirUserUnits.begin();
+      for (map<String, UnitName>::const_iterator iter = user.begin();
+           iter != user.end(); ++iter, ++defIter) {
+        const UnitVal& val = iter->second.getVal();
+        if (iter->first != defIter->first  ||
+            val.getFac() != defIter->second.first  ||
+            val != defIter->second.second) {
+          changed = True;
+          break;
+        }
+      }
+    }
+    if (changed) {
+      theirUnitCacheMap.clear();
+      theirUnitCacheList.clear();
+      theirUserUnits.clear();
+      for (map<String, UnitName>::const_iterator iter = user.begin();
+           iter != user.end(); ++iter) {
+        const UnitVal& val = iter->second.getVal();
+        theirUserUnits.insert (std::make_pair
+                               (iter->first,
+                                std::make_pair(val.getFac(), val)));
+      }
+      theirNrCustUnits = nrCust;
+    }
+  }
+
+  Unit cachedUnit (const String& unit) {
+    UnitCacheMap::iterator iter = theirUnitCacheMap.find (unit);
+    if (iter != theirUnitCacheMap.end()) {
+      theirUnitCacheList.splice (theirUnitCacheList.begin(),
+                                 theirUnitCacheList, iter->second.second);
+      return iter->second.first;
+    }
+    // Parse the unit (throws if invalid) before changing the cache.
+    Unit parsed(unit);
+    if (theirUnitCacheList.size() >= theirUnitCacheSize) {
+      theirUnitCacheMap.erase (theirUnitCacheList.back());
+      theirUnitCacheList.pop_back();
+    }
+    theirUnitCacheList.push_front (unit);
+    theirUnitCacheMap.insert (std::make_pair
+                              (unit, std::make_pair(parsed,
+                                                    theirUnitCacheList.begin())));
+    return parsed;
+  }
+
+  String canonicalUnit (const UnitVal& val) {
+    ostringstream oss;
+    oss << val.getDim();
+    return oss.str();
+  }
+
+  Double unitFactor(const String& from, const String& to) {
+    if (from == to) {
+      return 1.;
+    }
+    checkUnitCache();
+    UnitVal fromVal = cachedUnit(from).getValue();
+    UnitVal toVal = cachedUnit(to).getValue();
+    if (fromVal != toVal) {
+      throw(AipsError("Units " + from + " and " + to + " do not conform"));
+    }
+    return fromVal.getFac() / toVal.getFac();
+  }
+
   Quantity fromString(const String& str) {
     QuantumHolder qh;
     String err;
@@ -88,12 +188,22 @@ namespace casacore {
   // these functions take Unit as argument, enable outside access through
   // strings
   Quantity getWithUnit(const Quantity& q, const String& u)  {
-    Unit unit(u);
-    return q.get(unit);
+    return quantumGet (q, u);
   }
   Double getValueWithUnit(const Quantity& q, const String& u)  {
-    Unit unit(u);
-    return q.getValue(unit);
+    return quantumGetValue (q, u);
+  }
+  Quantity canonical(const Quantity& q)  {
+    return quantumCanonical (q);
+  }
+  void convertCanonical(Quantity& q)  {
+    q = quantumCanonical (q);
+  }
+  void convertWithUnit(Quantity& q, const String& u)  {
+    quantumConvert (q, u);
+  }
+  bool conformsUnit(const Quantity& q, const String& u)  {
+    return quantumConforms (q, u);
   }
 
   Quantity fromRecord(const Record& rec) {
@@ -149,6 +259,67 @@ namespace casacore {
       return Quantity(MVAngle(self)(a).degree(), "deg");
     }
 
+  // Format an array of times (given in the unit) as strings of the same
+  // shape. The unit factor and format are determined only once.
+  ValueHolder formatTimes(const ValueHolder& vh, const String& unit,
+                          const String& fmt, uInt prec) {
+    Array<Double> values = vh.asArrayDouble();
+    Double fac = unitFactor(unit, "d");
+    uInt form = fmt.empty() ? 0 : MVTime::giveMe(fmt);
+    Array<String> result(values.shape());
+    Array<String>::iterator resIter = result.begin();
+    for (Array<Double>::const_iterator iter = values.begin();
+         iter != values.end(); ++iter, ++resIter) {
+      MVTime mv(*iter * fac);
+      *resIter = (fmt.empty()  ?  mv.string(prec) : mv.string(form, prec));
+    }
+    return ValueHolder(result);
+  }
+
+  // Format an array of angles (given in the unit) as strings.
+  ValueHolder formatAngles(const ValueHolder& vh, const String& unit,
+                           const String& fmt, uInt prec) {
+    Array<Double> values = vh.asArrayDouble();
+    Double fac = unitFactor(unit, "rad");
+    uInt form = fmt.empty() ? 0 : MVAngle::giveMe(fmt);
+    Array<String> result(values.shape());
+    Array<String>::iterator resIter = result.begin();
+    for (Array<Double>::const_iterator iter = values.begin();
+         iter != values.end(); ++iter, ++resIter) {
+      MVAngle mv(*iter * fac);
+      *resIter = (fmt.empty()  ?  mv.string(prec) : mv.string(form, prec));
+    }
+    return ValueHolder(result);
+  }
+
+  // Parse an array of time or angle strings into values in the given unit.
+  ValueHolder parseTimesAngles(const ValueHolder& vh, const String& unit,
+                               Bool isTime) {
+    Array<String> strs = vh.asArrayString();
+    Array<Double> result(strs.shape());
+    Array<Double>::iterator resIter = result.begin();
+    Quantity res;
+    for (Array<String>::const_iterator iter = strs.begin();
+         iter != strs.end(); ++iter, ++resIter) {
+      Bool ok = (isTime  ?  MVTime::read (res, *iter)
+                         :  MVAngle::read (res, *iter));
+      if (!ok) {
+        throw(AipsError("Invalid " + String(isTime ? "time" : "angle") +
+                        " string " + *iter));
+      }
+      *resIter = res.getValue() * unitFactor(res.getUnit(), unit);
+    }
+    return ValueHolder(result);
+  }
+
+  ValueHolder parseTimes(const ValueHolder& vh, const String& unit) {
+    return parseTimesAngles(vh, unit, True);
+  }
+
+  ValueHolder parseAngles(const ValueHolder& vh, const String& unit) {
+    return parseTimesAngles(vh, unit, False);
+  }
+
 }}
 
 namespace casacore { namespace python {
@@ -168,13 +339,15 @@ namespace casacore { namespace python {
       .def ("get_unit", &Quantity::getUnit,
 	    return_value_policy < copy_const_reference> ())
       .def ("convert", (void ( Quantity::* )( const Quantity& ) )(&Quantity::convert))
-      .def ("convert", (void ( Quantity::* )( ) )(&Quantity::convert))
+      .def ("convert", &convertCanonical)
+      .def ("convert", &convertWithUnit)
       .def ("set_value", &Quantity::setValue)
-      .def ("get", (Quantity ( Quantity::* )( ) const)(&Quantity::get))
-      .def ("canonical", (Quantity ( Quantity::* )( ) const)(&Quantity::get))
+      .def ("get", &canonical)
+      .def ("canonical", &canonical)
       .def ("get", (Quantity ( Quantity::* )( const Quantity& ) const)(&Quantity::get))
       .def ("get", &getWithUnit)
       .def ("conforms", &conforms)
+      .def ("conforms", &conformsUnit)
       .def ("totime", &toTime)
       .def ("to_time", &toTime)
       .def ("toangle", &toAngle)
@@ -230,6 +403,11 @@ namespace casacore { namespace python {
       ;
     def ("from_string", &fromString);
     def ("from_dict", &fromRecord);
+    def ("unit_factor", &unitFactor);
+    def ("_format_times", &formatTimes);
+    def ("_format_angles", &formatAngles);
+    def ("_parse_times", &parseTimes);
+    def ("_parse_angles", &parseAngles);
       
   }
 }}
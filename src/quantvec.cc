@@ -25,12 +25,15 @@
 //#
 //# $Id:$
 
+#include "quanta.h"
+
 #include <casacore/casa/Quanta.h>
 #include <casacore/casa/Quanta/QLogical.h>
 #include <casacore/casa/Quanta/QuantumHolder.h>
 #include <casacore/casa/Quanta/MVTime.h>
 #include <casacore/casa/Quanta/MVAngle.h>
 
+#include <casacore/casa/Arrays/ArrayMath.h>
 #include <casacore/casa/Containers/Record.h>
 #include <casacore/casa/Exceptions/Error.h>
 #include <casacore/casa/sstream.h>
@@ -57,12 +60,22 @@ namespace casacore {
   // these functions take Unit as argument, enable outside access through
   // strings
   QProxy qpgetWithUnit(const QProxy& q, const String& u)  {
-    Unit unit(u);
-    return q.get(unit);
+    return quantumGet (q, u);
   }
   VD qpgetValueWithUnit(const QProxy& q, const String& u)  {
-    Unit unit(u);
-    return q.getValue(unit);
+    return quantumGetValue (q, u);
+  }
+  QProxy qpcanonical(const QProxy& q)  {
+    return quantumCanonical (q);
+  }
+  void qpconvertCanonical(QProxy& q)  {
+    q = quantumCanonical (q);
+  }
+  void qpconvertWithUnit(QProxy& q, const String& u)  {
+    quantumConvert (q, u);
+  }
+  bool qpconformsUnit(const QProxy& q, const String& u)  {
+    return quantumConforms (q, u);
   }
 
   QProxy qpfromRecord(const Record& rec) {
@@ -207,14 +220,16 @@ namespace casacore { namespace python {
       .def ("get_unit", &QProxy::getUnit,
 	    return_value_policy < copy_const_reference> ())
       .def ("convert", (void ( QProxy::* )( const QProxy& ) )(&QProxy::convert))
-      .def ("convert", (void ( QProxy::* )( ) )(&QProxy::convert))
+      .def ("convert", &qpconvertCanonical)
+      .def ("convert", &qpconvertWithUnit)
       .def ("set_value", &QProxy::setValue)
-      .def ("get", (QProxy ( QProxy::* )( ) const)(&QProxy::get))
-      .def ("canonical", (QProxy ( QProxy::* )( ) const)(&QProxy::get))
+      .def ("get", &qpcanonical)
+      .def ("canonical", &qpcanonical)
       .def ("get", 
 	    (QProxy ( QProxy::* )( const QProxy& ) const)(&QProxy::get))
       .def ("get", &qpgetWithUnit)
       .def ("conforms", &qpconforms)
+      .def ("conforms", &qpconformsUnit)
       .def ("norm", &norm, (boost::python::arg("self"), boost::python::arg("a")=-0.5))
       .def ("totime", &qptoTime)
       .def ("to_time", &qptoTime)
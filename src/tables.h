@@ -37,6 +37,7 @@ namespace casacore {
     void pytablerow();
     void pytableiter();
     void pytableindex();
+    void pytablecopy();
 
     void pyms();
 
@@ -184,6 +184,22 @@ def testna():
     print(t.testvh({'shape':[2,2], 'array':['abcd','c','12','x12']}))
 
 
+def testbuffer(t):
+    print('')
+    print('begin testbuffer')
+    arr = NUM.arange(12, dtype=NUM.float64).reshape(3, 4)
+    print(t.testbufin(arr))                 # borrowed, no copy
+    print(t.testbufin(arr[:, ::2]))         # not contiguous, copied
+    print(t.testbufin(arr.astype(NUM.float32)))   # other type, copied
+    out = t.testbufout(arr)
+    print(out.shape, out.dtype, out[2, 3])
+    print(t.testbufout(NUM.array([1 + 2j, 3j], NUM.complex64)))
+    print(t.testbufout(['a', 'b']))
+    print(t.bytescopied())
+    t.benchbuffer(NUM.zeros((1000, 1000)), 100)
+    print('end testbuffer')
+
+
 t = tConvert()
 
 print("Doing numpy/array test ...")
@@ -194,6 +210,7 @@ else:
     import numarray as NUM
     testna()
 dotest(t)
+testbuffer(t)
 
 print("")
 print("Doing numarray/py test ...")
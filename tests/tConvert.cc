@@ -31,6 +31,9 @@
 #include <casacore/python/Converters/PycRecord.h>
 #include <casacore/python/Converters/PycArray.h>
 #include <casa/Arrays/ArrayIO.h>
+#include <casa/Arrays/ArrayMath.h>
+#include <casa/OS/Timer.h>
+#include "../src/pybuffer.h"
 
 #include <boost/python.hpp>
 
@@ -88,6 +91,59 @@ namespace casa { namespace pyrap {
       {cout << "vecvecuInt " << in << endl; return in;}
     IPosition testipos (const IPosition& in)
       {cout << "IPos " << in << endl; return in;}
+    // The zero-copy buffer converters.
+    // The argument is owned by the caller, so its data are copied.
+    boost::python::object testbufout (const ValueHolder& in)
+      {ValueHolder vh(in); return casacore::python::valueHolderToPython (vh);}
+    Double testbufin (PyObject* in)
+    {
+      casacore::python::BorrowedArray<Double> arr(in);
+      cout << "borrowed " << arr.borrowed() << ' ' << arr.array().shape()
+           << endl;
+      return sum(arr.array());
+    }
+    Int64 bytescopied()
+      {return casacore::python::pyBufferBytesCopied();}
+    // Convert an array n times each way with the buffer converters and
+    // the ValueHolder converters, and show the bytes copied per call.
+    void benchbuffer (PyObject* in, Int n)
+    {
+      using namespace casacore::python;
+      boost::python::object obj (boost::python::handle<>
+                                 (boost::python::borrowed(in)));
+      Int64 nb = pyBufferBytesCopied();
+      Timer timer;
+      for (Int i=0; i<n; ++i) {
+        BorrowedArray<Double> arr(in);
+      }
+      Double tin = timer.real();
+      timer.mark();
+      ValueHolder vh = boost::python::extract<ValueHolder>(obj);
+      // Hand over a new array each time, like the getters returning the
+      // result of a table or image read; its data need not be copied.
+      IPosition shape (vh.asArrayDouble().shape());
+      for (Int i=0; i<n; ++i) {
+        Array<Double> arr (shape);
+        boost::python::object out = arrayToPython (arr);
+      }
+      Double tout = timer.real();
+      cout << "buffer:      " << (pyBufferBytesCopied() - nb) / (2*n)
+           << " bytes copied per call; in " << 1e6*tin/n
+           << " us, out " << 1e6*tout/n << " us" << endl;
+      timer.mark();
+      for (Int i=0; i<n; ++i) {
+        ValueHolder vh2 = boost::python::extract<ValueHolder>(obj);
+      }
+      tin = timer.real();
+      timer.mark();
+      for (Int i=0; i<n; ++i) {
+        boost::python::object out (vh);
+      }
+      tout = timer.real();
+      cout << "valueholder: " << vh.asArrayDouble().size() * sizeof(Double)
+           << " bytes copied per call; in " << 1e6*tin/n
+           << " us, out " << 1e6*tout/n << " us" << endl;
+    }
     Bool canusenumpy()
       {return PycCanUseNumpy();}
     Bool canusenumarray()
@@ -115,6 +171,10 @@ namespace casa { namespace pyrap {
       .def ("teststdvecuint", &TConvert::teststdvecuint)
       .def ("teststdvecvecuint", &TConvert::teststdvecvecuint)
       .def ("testipos",       &TConvert::testipos)
+      .def ("testbufout",     &TConvert::testbufout)
+      .def ("testbufin",      &TConvert::testbufin)
+      .def ("bytescopied",    &TConvert::bytescopied)
+      .def ("benchbuffer",    &TConvert::benchbuffer)
       .def ("canusenumpy",    &TConvert::canusenumpy)
       .def ("canusenumarray", &TConvert::canusenumarray)
       ;
@@ -7,4 +7,51 @@ class TestFitting(unittest.TestCase):
         self.fitserver = fitting.fitserver()
 
     def test_fitter(self):
-        self.fitserver.fitter()
\ No newline at end of file
+        self.fitserver.fitter()
+
+    def test_fit_many(self):
+        import numpy
+        x = numpy.linspace(-5, 5, 101)
+        params = numpy.array([[1, 0, 1], [2, 1, 1.5], [0.5, -1, 2]])
+        y = numpy.array([fitting.gaussian1d(p)(x) for p in params])
+        res = self.fitserver.fit_many(fitting.gaussian1d(), x, y,
+                                      initial=[1, 0, 1], nthreads=2)
+        self.assertEqual(res['sol'].shape, (3, 3))
+        self.assertTrue(res['converged'].all())
+        numpy.testing.assert_allclose(res['sol'], params, atol=1e-6)
+        res = self.fitserver.fit_many(fitting.poly(2), x, 2 + 0.5 * x - x * x,
+                                      linear=True)
+        numpy.testing.assert_allclose(res['sol'][0], [2, 0.5, -1], atol=1e-8)
+
+    def test_accumulate(self):
+        import numpy
+        import pickle
+        x = numpy.linspace(-5, 5, 1000)
+        y = 2 + 0.5 * x - x * x
+        fid = self.fitserver.fitter()
+        for i in range(0, 1000, 300):
+            self.fitserver.accumulate(fitting.poly(2), x[i:i + 300],
+                                      y[i:i + 300], fid=fid)
+        numpy.testing.assert_allclose(self.fitserver.solve(fid),
+                                      [2, 0.5, -1], atol=1e-8)
+        self.assertEqual(self.fitserver.rank(fid), 3)
+        # Accumulate two halves separately and merge them.
+        ne1 = fitting.normeq(fitting.poly(2))
+        ne2 = pickle.loads(pickle.dumps(ne1))
+        ne1.accumulate(x[:500], y[:500])
+        ne2.accumulate(x[500:], y[500:])
+        ne1.merge(ne2)
+        self.assertEqual(ne1.nequations(), 1000)
+        numpy.testing.assert_allclose(ne1.solve()['sol'], [2, 0.5, -1],
+                                      atol=1e-8)
+
+    def test_prepare(self):
+        import numpy
+        x = numpy.linspace(-5, 5, 101)
+        pf = self.fitserver.prepare(fitting.gaussian1d([1, 0, 1]))
+        self.assertEqual(pf.npar(), 3)
+        for params in ([1, 0, 1], [2, 1, 1.5], [0.5, -1, 2]):
+            y = fitting.gaussian1d(params)(x)
+            res = pf.fit(x, y)
+            self.assertTrue(res['converged'])
+            numpy.testing.assert_allclose(res['sol'], params, atol=1e-6)
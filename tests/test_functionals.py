@@ -276,3 +276,82 @@ class TestFunctionals(unittest.TestCase):
                                                    1.,
                                                    0.84147098]))
 
+
+    def test_fasteval(self):
+        from casacore.functionals.functional import _functional
+        x = numpy.linspace(-3, 3, 200001)
+        s = compound()
+        s.add(gaussian1d([2, 0.5, 1.5]))
+        s.add(poly(2, [1, -1, 0.5]))
+        s.add(evenpoly(2, [0.5, 0.25]))
+        s.add(oddpoly(2, [0.5, 0.25]))
+        s.add(chebyshev(3, [1, 2, 3, 4], xmin=-2, xmax=2))
+        self.assertIsNotNone(s._fast)
+        numpy.testing.assert_allclose(s.f(x), _functional._f(s, x))
+        numpy.testing.assert_allclose(s._fastf(x, 1), s._fastf(x, 4))
+        c = combi()
+        c.add(poly(1))
+        self.assertIsNone(c._fast)
+
+    def test_compiled_kernel(self):
+        b = compiled('p*exp(-(x/p[2])^2) + (x>0 ? p1*x : -p1*x)')
+        self.assertIsNotNone(b._kernel)
+        b.set_parameters([10, 2])
+        x = numpy.linspace(-3, 3, 1001)
+        numpy.testing.assert_allclose(b.f(x), _functional_f(b, x))
+        numpy.testing.assert_allclose(b.fdf(x), _functional_fdf(b, x))
+        self.assertIsNotNone(b._kernel)
+        c = compiled('atan2(x, p) + log10(abs(x)+1) - sqrt(x^2+p1^2)')
+        c.set_parameters([1.5, 0.5])
+        numpy.testing.assert_allclose(c.fdf(x), _functional_fdf(c, x))
+
+    def test_compiled_kernel_grammar(self):
+        """The kernel gives the same results as CompiledFunction."""
+        # x in [0.1,0.9], so all functions are defined.
+        x = numpy.linspace(0.1, 0.9, 9)
+        exprs = ['p0 + p1*x - p2/x', '-p*x + +p1', 'p[1]*x + p[2]*x*x',
+                 '(p*x)^2 + x^p1 + p^p1', 'pow(p, x) + pow(x, p1)',
+                 '-p^2*x', 'pi + pi() + pi(p) + ee + ee(x*p)',
+                 'sin(p*x) + cos(p*x) + tan(p*x)',
+                 'asin(p*x) + acos(p*x) + atan(p*x)',
+                 'exp(p*x) + log(p*x) + log10(p*x) + sqrt(p*x)',
+                 'sinh(p*x) + cosh(p*x) + tanh(p*x)',
+                 'abs(p-x-0.05) + floor(p*x*3) + ceil(p*x*3)',
+                 'square(p*x) + cube(p1*x)',
+                 'atan2(p, x) + atan(x, p1) + fmod(p*x, p1)',
+                 'min(p, x+0.05) + max(p1*x, 0.5)',
+                 '(x == 0.5) + (x != 0.5) + (x < p) + (x <= p) + '
+                 '(x > p) + (x >= p)',
+                 '((x > 0.2) && (x < p)) + (x < 0.2 || x > p) + !(x > p)',
+                 'x > p ? p1*x : p*x*x', '(x > p ? p1 : p) * x',
+                 'sqrt(x) * p', '(x > 0.5) * p + p1']
+        for expr in exprs:
+            fn = compiled(expr)
+            self.assertIsNotNone(fn._kernel, expr)
+            fn.set_parameters([0.5, 1.5, 2.5][:fn.npar()])
+            numpy.testing.assert_allclose(fn.f(x), _functional_f(fn, x),
+                                          err_msg=expr)
+            numpy.testing.assert_allclose(fn.fdf(x), _functional_fdf(fn, x),
+                                          err_msg=expr)
+        # Constructs of which the meaning is not certain are rejected by
+        # the kernel, so CompiledFunction is used for them.
+        from casacore.functionals.functional import _exprkernel
+        for expr in ['x < p < p1', 'x == p < p1', 'x > p && x < p1 || x < 0.2',
+                     'x^p^p1', 'x^-p', 'x > p ? 1 : x > p1 ? 2 : 3',
+                     'x > p ? 1 : p1*x']:
+            self.assertRaises(RuntimeError, _exprkernel, expr)
+        fn = compiled('x > p ? 1 : p1*x')
+        self.assertIsNone(fn._kernel)
+        fn.set_parameters([0.5, 1.5])
+        numpy.testing.assert_allclose(fn.fdf(x), _functional_fdf(fn, x))
+
+
+def _functional_f(fn, x):
+    from casacore.functionals.functional import _functional
+    return numpy.array(_functional._f(fn, x))
+
+
+def _functional_fdf(fn, x):
+    from casacore.functionals.functional import _functional
+    return numpy.array(_functional._fdf(fn, x)).reshape(
+        fn.npar() + 1, len(x)).transpose()
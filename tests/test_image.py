@@ -49,6 +49,29 @@ class TestImage(unittest.TestCase):
                                    numpy.array([[1, 2, 3],
                                                 [7, 8, 9]]))
 
+    def test_getdata_tempimage(self):
+        """Writing into the data of an in-memory image leaves it intact."""
+        im = image("", shape=[4, 3])
+        im.put(numpy.ones((4, 3), numpy.float32))
+        d = im.getdata()
+        d[0, 0] = 5
+        self.assertEqual(im.getdata()[0, 0], 1)
+
+    def test_putdata_nocopy(self):
+        """Pixels are put and got without copying them."""
+        from casacore.images._images import _bytescopied
+        im = image("testimg", shape=[4, 3])
+        data = numpy.arange(12, dtype=numpy.float32).reshape(4, 3)
+        nbytes = _bytescopied()
+        im.putdata(data)
+        d = im.getdata()
+        self.assertEqual(_bytescopied(), nbytes)
+        numpy.testing.assert_equal(d, data)
+        # Other data types are converted, so they are counted as copied.
+        im.putdata(numpy.ones((4, 3)))
+        self.assertEqual(_bytescopied(), nbytes + 12 * 4)
+        numpy.testing.assert_equal(im.getdata(), numpy.ones((4, 3)))
+
     def test_image_mask(self):
         """Test image mask."""
         im1 = image("testimg", shape=[2, 3])
@@ -88,6 +111,30 @@ class TestImage(unittest.TestCase):
                                    numpy.array([[2.,   4.,   6.],
                                                 [8.,  10.,  12.]]))
 
+    def test_lazyexpr(self):
+        """Build a lazy expression from image objects."""
+        im = image("testimg", shape=[2, 3])
+        im.put(numpy.array([[1, 2, 3], [4, 5, 6]]))
+        ex = im * 2 + im.mask(im > 3)
+        self.assertEqual(ex.lel(), ('(($1*2)+($1)[($1>3)])', [im]))
+        numpy.testing.assert_equal(ex.getdata()[1],
+                                   numpy.array([12., 15., 18.]))
+        numpy.testing.assert_equal(ex.getmask(),
+                                   numpy.array([[True,  True,  True],
+                                                [False, False, False]]))
+        self.assertEqual(str(im == 2), '($1==2)')
+        self.assertEqual(str(im != 2), '($1!=2)')
+        self.assertRaises(TypeError, bool, im == 2)
+        self.assertEqual(str(im + float('nan')), '($1+nan())')
+        self.assertEqual(str(im * float('-inf')), '($1*(-inf()))')
+        data = (im + float('inf')).getdata()
+        self.assertTrue(numpy.all(numpy.isinf(data)))
+        self.assertTrue(numpy.all(numpy.isnan((im + float('nan')).getdata())))
+        imout = (1 - im.expr() / 2).saveas('timage.py_tmp.img3')
+        numpy.testing.assert_equal(imout.getdata(),
+                                   numpy.array([[0.5, 0., -0.5],
+                                                [-1., -1.5, -2.]]))
+
     def test_subset(self):
         """Create a subset and update it."""
         im = image("testimg", shape=[2, 3])
@@ -111,6 +158,16 @@ class TestImage(unittest.TestCase):
         numpy.testing.assert_equal(imc1.getdata(),
                                    numpy.array([[1, 2, 3, 1, 2, 3],
                                                 [4, 5, 6, 4, 5, 6]]))
+        chunks = list(imc1.iterchunks((2, 2)))
+        self.assertEqual(len(chunks), 3)
+        self.assertEqual(chunks[2][0], [0, 4])
+        numpy.testing.assert_equal(chunks[2][1],
+                                   numpy.array([[2, 3], [5, 6]]))
+        result = numpy.zeros(imc1.shape())
+        for (blc, data) in imc1.iterchunks(prefetch=False):
+            result[blc[0]:blc[0]+data.shape[0],
+                   blc[1]:blc[1]+data.shape[1]] = data
+        numpy.testing.assert_equal(result, imc1.getdata())
         imc1.saveas('timage.py_tmp.img1')
         imc2 = image('timage.py_tmp.img1')
         numpy.testing.assert_equal(imc2.getdata(),
@@ -142,6 +199,77 @@ class TestImage(unittest.TestCase):
         imex2.tofits('timage.py_tmp.fits')
         imex3 = image('timage.py_tmp.fits')
         print(imex3.getdata())
+        imex2.tofits('timage.py_tmp2.fits', memory=1)
+        imex4 = image('timage.py_tmp2.fits')
+        numpy.testing.assert_equal(imex4.getdata(), imex3.getdata())
+        imd = image('', values=numpy.arange(6.).reshape(2, 3))
+        self.assertEqual(imd.datatype(), 'double')
+        imd.tofits('timage.py_tmp3.fits', memory=1)
+        numpy.testing.assert_equal(image('timage.py_tmp3.fits').getdata(),
+                                   numpy.arange(6.).reshape(2, 3))
+        # A chunked export with multiple chunks reports its progress.
+        imc = image('', values=numpy.arange(60000, dtype='float32')
+                    .reshape(3, 200, 100))
+        done = []
+        imc.tofits('timage.py_tmp4.fits', memory=1, nthreads=2,
+                   progress=lambda n, total: done.append((n, total)))
+        self.assertTrue(len(done) > 1)
+        self.assertEqual(done[-1], (60000, 60000))
+        numpy.testing.assert_equal(image('timage.py_tmp4.fits').getdata(),
+                                   imc.getdata())
+        imc.tofits('timage.py_tmp5.fits', bitpix=16, memory=1)
+        numpy.testing.assert_allclose(image('timage.py_tmp5.fits').getdata(),
+                                      imc.getdata(), atol=1)
+
+    def test_compressed(self):
+        """Save an image with compressed pixels."""
+        im = image("testimg", shape=[4, 3])
+        data = numpy.arange(12, dtype='float32').reshape(4, 3)
+        im.put(data)
+        im.saveas('timage.py_tmp.img4', compress='scaled')
+        im2 = image('timage.py_tmp.img4')
+        self.assertEqual(im2.shape(), [4, 3])
+        numpy.testing.assert_allclose(im2.getdata(), data, atol=11./65534)
+        numpy.testing.assert_allclose(im2.getdata((1, 1), (2, 2)),
+                                      data[1:3, 1:3], atol=11./65534)
+        self.assertRaises(Exception, im.saveas, 'timage.py_tmp.img5',
+                          compress='zstd')
+
+    def test_compressed_masked(self):
+        """Masked pixels are not clipped when saving compressed."""
+        im = image("testimg", shape=[2, 3])
+        data = numpy.array([[1, 2, 3], [4, 5, 100]], dtype='float32')
+        im.put(nma.masked_array(data, mask=[[False, False, False],
+                                            [False, False, True]]))
+        im.saveas('timage.py_tmp.img4', compress='scaled', copymask=True)
+        im2 = image('timage.py_tmp.img4')
+        numpy.testing.assert_allclose(im2.getdata(), data, atol=99./65534)
+        numpy.testing.assert_equal(im2.getmask(), im.getmask())
+        im.put(nma.masked_array(data, mask=numpy.ones((2, 3), bool)))
+        im.saveas('timage.py_tmp.img5', compress='scaled', copymask=True)
+        im3 = image('timage.py_tmp.img5')
+        self.assertTrue(numpy.all(im3.getmask()))
+        numpy.testing.assert_allclose(im3.getdata(), data, atol=99./65534)
+
+    def test_pyramid(self):
+        """Build a pyramid and read from its levels."""
+        im = image("testimg", shape=[3, 8, 8])
+        data = numpy.arange(192, dtype='float32').reshape(3, 8, 8)
+        im.put(data)
+        im.build_pyramid(2)
+        self.assertEqual(im.pyramidlevels(), 2)
+        numpy.testing.assert_equal(im.getdata(inc=(1, 4, 4), level=2),
+                                   data[:, ::4, ::4])
+        numpy.testing.assert_equal(im.getdata((1, 2, 0), (2, 7, 6),
+                                              (1, 2, 4), level=1),
+                                   data[1:3, 2:8:2, 0:7:4])
+        self.assertRaises(ValueError, im.getdata, inc=(1, 1, 2), level=1)
+        im.build_pyramid(1)
+        self.assertEqual(im.pyramidlevels(), 1)
+        self.assertRaises(ValueError, im.getdata, inc=(1, 4, 4), level=2)
+        self.assertFalse(os.path.exists(im.name() + '/PYRAMID2'))
+        numpy.testing.assert_equal(im.getdata(inc=(1, 2, 2), level=1),
+                                   data[:, ::2, ::2])
 
     def test_image_coordinate(self):
         """Get some info on a coordinate system and change it."""
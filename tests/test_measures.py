@@ -1,7 +1,100 @@
 import unittest2 as unittest
+import numpy
 from casacore import measures
 
 
 class TestMeasures(unittest.TestCase):
     def test_something(self):
-        pass
\ No newline at end of file
+        pass
+
+    def test_measure_many(self):
+        dm = measures.measures()
+        radec = numpy.array([[0.1, 0.5], [1.2, -0.3], [4.0, 1.1]])
+        out = dm.measure_many('direction', radec, 'B1950')
+        self.assertEqual(out.shape, (3, 2))
+        for i in range(3):
+            d = dm.measure(dm.direction('J2000', '%frad' % radec[i][0],
+                                        '%frad' % radec[i][1]), 'B1950')
+            self.assertAlmostEqual(out[i][0] % (2 * numpy.pi),
+                                   d['m0']['value'] % (2 * numpy.pi))
+            self.assertAlmostEqual(out[i][1], d['m1']['value'])
+        # Convert to AZEL with a different epoch per direction.
+        dm.do_frame(dm.observatory('WSRT'))
+        times = 86400. * numpy.array([57000., 57000., 57000.25])
+        azel = dm.measure_many('direction', radec, 'AZEL',
+                               frame_epochs=times)
+        dm.do_frame(dm.epoch('UTC', '%fs' % times[2]))
+        d = dm.measure(dm.direction('J2000', '4rad', '1.1rad'), 'AZEL')
+        self.assertAlmostEqual(azel[2][1], d['m1']['value'])
+        azel4 = dm.measure_many('direction', radec, 'AZEL',
+                                frame_epochs=times, nthreads=4)
+        numpy.testing.assert_allclose(azel4, azel)
+        tai = dm.measure_many('epoch', times, 'TAI')
+        self.assertAlmostEqual(tai[0] - times[0], 35., 3)
+
+    def test_frame_cache(self):
+        dm = measures.measures()
+        old = dm.set_frame_cache('0d')
+        self.assertEqual(dm.get_frame_cache()['nutation'], 0.)
+        self.assertRaises(TypeError, dm.set_frame_cache)
+        radec = numpy.array([[1.2, -0.3]] * 50)
+        times = 86400. * (57000. + 0.01 * numpy.arange(50))
+        exact = dm.measure_many('direction', radec, 'APP',
+                                frame_epochs=times)
+        self.assertEqual(dm.get_frame_cache()['nutation'], 0.)
+        self.assertEqual(dm.set_frame_cache('0.5d')['aberration'], 0.)
+        approx = dm.measure_many('direction', radec, 'APP',
+                                 frame_epochs=times)
+        # The value must survive conversions.
+        self.assertEqual(dm.get_frame_cache(),
+                         {'precession': 0.5, 'nutation': 0.5,
+                          'aberration': 0.5})
+        # The documented bound is 0.027*dt**2 arcsec; allow a margin.
+        bound = 2 * 0.027 * 0.5**2 / 3600 * numpy.pi / 180
+        self.assertLess(numpy.abs(approx - exact).max(), bound)
+        for (name, interval) in old.items():
+            dm.set_frame_cache('%fd' % interval, [name])
+
+    def test_uvw_grid(self):
+        dm = measures.measures()
+        pos = numpy.array([[3828763., 442449., 5064923.],
+                           [3828746., 442592., 5064924.],
+                           [3828729., 442735., 5064925.]])
+        times = 86400. * (57000. + numpy.array([0., 0.01]))
+        phase = dm.direction('J2000', '1.2rad', '0.8rad')
+        uvw = dm.uvw_grid(pos, times, phase)
+        self.assertEqual(uvw.shape, (2, 3, 3))
+        buvw = dm.uvw_grid(pos, times, phase, [0, 0], [1, 2], nthreads=2)
+        numpy.testing.assert_allclose(buvw[:, 1], uvw[:, 2] - uvw[:, 0])
+        # Compare with touvw for a single baseline.
+        dm.do_frame(dm.position('ITRF', '3828763m', '442449m', '5064923m'))
+        dm.do_frame(phase)
+        dm.do_frame(dm.epoch('UTC', '%fs' % times[1]))
+        b = dm.baseline('ITRF', '%fm' % (pos[1][0] - pos[0][0]),
+                        '%fm' % (pos[1][1] - pos[0][1]),
+                        '%fm' % (pos[1][2] - pos[0][2]))
+        xyz = dm.touvw(b)['xyz'].get_value('m')
+        numpy.testing.assert_allclose(buvw[1, 0], xyz, atol=1e-3)
+
+    def test_separation_many(self):
+        dm = measures.measures()
+        d0 = numpy.array([[0., numpy.radians(70)], [1., 0.5]])
+        d1 = numpy.array([[0., numpy.radians(80)], [1., 0.4]])
+        sep = dm.separation_many(d0, d1)
+        self.assertAlmostEqual(sep[0], numpy.radians(10))
+        self.assertAlmostEqual(sep[1], 0.1)
+        self.assertEqual(dm.separation_many(d0, d1, outer=True).shape, (2, 2))
+        pa = dm.posangle_many(d0, d1)
+        self.assertAlmostEqual(pa[0], 0.)
+
+    def test_rise_many(self):
+        dm = measures.measures()
+        dm.do_frame(dm.observatory('WSRT'))
+        dm.do_frame(dm.epoch('UTC', '57000d'))
+        dirs = numpy.array([[1., 1.5], [1., -1.5], [1., 0.3]])
+        rs = dm.rise_many(dirs)
+        self.assertEqual(list(rs['above']), [True, False, False])
+        self.assertEqual(list(rs['below']), [False, True, False])
+        r = dm.rise(dm.direction('J2000', '1rad', '0.3rad'))
+        self.assertAlmostEqual(rs['rise'][2] % (2 * numpy.pi),
+                               r['rise'].get_value('rad') % (2 * numpy.pi))
@@ -38,3 +38,75 @@ class TestQuanta(unittest.TestCase):
         self.assertEqual(units['Jy'], ['jansky', quantity(1e-26, 'kg.s-2')])
         self.assertIn('a',prefixes)
         self.assertEqual(prefixes['a'],['atto',1e-18])
+
+    def test_quantarray(self):
+        import numpy
+        v = quantarray(numpy.arange(4, dtype='float32'), 'km/s')
+        self.assertAlmostEqual(unit_factor('km/s', 'm/s'), 1000.)
+        self.assertTrue(v.conforms('m/s'))
+        self.assertFalse(v.conforms('Jy'))
+        w = v + quantity(1, 'm/s')
+        self.assertEqual(w.unit, 'km/s')
+        self.assertAlmostEqual(w.value[1], 1.001, 5)
+        v.convert('m/s')
+        self.assertEqual(v.dtype, numpy.float32)
+        self.assertEqual(list(v.value), [0, 1000, 2000, 3000])
+        d = v * quantarray([2, 2, 2, 2], 's')
+        self.assertEqual(list(d.get_value('km')), [0, 2, 4, 6])
+        self.assertTrue(numpy.all((d / 2).get_value('m') ==
+                                  v.get_value()))
+        self.assertEqual(list(v > quantity(1, 'km/s')),
+                         [False, False, True, True])
+
+    def test_converter(self):
+        import numpy
+        c = converter('km/s', 'm/s')
+        self.assertAlmostEqual(c(3.5), 3500.)
+        self.assertEqual(list(c([1, 2])), [1000., 2000.])
+        self.assertEqual(list(c.inverse()(numpy.array([500., 1500.]))),
+                         [0.5, 1.5])
+        v = c(quantarray([1., 2.], 'm/s'))
+        self.assertEqual(v.unit, 'm/s')
+        self.assertEqual(list(v.value), [1., 2.])
+        self.assertRaises(Exception, converter, 'km/s', 'Jy')
+        # Repeated use of the same units comes from the unit cache.
+        for i in range(3):
+            self.assertAlmostEqual(unit_factor('km/s', 'm/s'), 1000.)
+        self.assertAlmostEqual(quantity(2, 'km').get_value('m'), 2000.)
+        # Angle and time convert into each other as before.
+        self.assertAlmostEqual(quantity('1h').get_value('deg'), 15.)
+        self.assertAlmostEqual(quantity('30deg').get_value('h'), 2.)
+        degs = quantity([1., 2.], 'h').get_value('deg')
+        self.assertAlmostEqual(degs[0], 15.)
+        self.assertAlmostEqual(degs[1], 30.)
+        # Conversions using unit strings go through the unit cache too.
+        q = quantity(36, 'km/h')
+        self.assertTrue(q.conforms('m/s'))
+        self.assertFalse(q.conforms('Jy'))
+        self.assertAlmostEqual(q.canonical().get_value(), 10.)
+        self.assertTrue(q.canonical().conforms(q))
+        self.assertAlmostEqual(q.get('m/s').get_value(), 10.)
+        q.convert('m/s')
+        self.assertEqual(q.get_unit(), 'm/s')
+        self.assertAlmostEqual(q.get_value(), 10.)
+        q.convert()
+        self.assertAlmostEqual(q.get_value(), 10.)
+        v = quantity([36., 72.], 'km/h')
+        self.assertTrue(v.conforms('m/s'))
+        self.assertAlmostEqual(v.canonical().get_value()[1], 20.)
+
+    def test_format_parse_many(self):
+        import numpy
+        times = numpy.array([[4914741782.5, 4914741783.5]])
+        strs = format_times(times, 's', 'DMY')
+        self.assertEqual(strs.shape, (1, 2))
+        self.assertEqual(strs[0, 0], quantity(times[0, 0], 's').formatted('DMY'))
+        back = parse_times(strs, 's')
+        self.assertEqual(back.shape, (1, 2))
+        self.assertAlmostEqual(back[0, 1], times[0, 1], 0)
+        angles = format_angles([0.5, -0.25], 'rad', 'ANGLE', 9)
+        self.assertEqual(angles[1], quantity(-0.25, 'rad').formatted('ANGLE', 9))
+        vals = parse_angles(['12h', '-30.30.0'], 'deg')
+        self.assertAlmostEqual(vals[0], 180.)
+        self.assertAlmostEqual(vals[1], -30.5)
+        self.assertRaises(Exception, parse_angles, ['xyz'])
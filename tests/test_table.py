@@ -109,6 +109,146 @@ class TestTable(unittest.TestCase):
         t.close()
         tabledelete("ttable.py_tmp.tab1")
 
+    def test_getcol_nocopy(self):
+        """Numeric columns are handed to numpy without a copy."""
+        c1 = makescacoldesc("cold", 0.)
+        c2 = makearrcoldesc("colc", 0j, shape=[3, 2])
+        c3 = makescacoldesc("cols", "")
+        t = table("ttable.py_tmp.tab1", maketabdesc((c1, c2, c3)), ack=False)
+        t.addrows(4)
+        from casacore.tables._tables import _bytescopied
+        nbytes = _bytescopied()
+        t.putcol("cold", numpy.arange(4.))
+        t.putcol("colc", numpy.ones((4, 3, 2), numpy.complex128) * 1j)
+        d = t.getcol("cold")
+        c = t.getcol("colc")
+        self.assertEqual(_bytescopied(), nbytes)
+        # A value of another type is converted and counted as copied.
+        t.putcol("cold", numpy.arange(4, dtype=numpy.int32))
+        self.assertEqual(_bytescopied(), nbytes + 4 * 8)
+        numpy.testing.assert_array_equal(t.getcol("cold"), numpy.arange(4.))
+        t.putcol("cold", numpy.arange(4.))
+        self.assertEqual(_bytescopied(), nbytes + 4 * 8)
+        # The data is owned by the casacore array exported as a buffer.
+        self.assertFalse(d.flags.owndata)
+        base = d.base
+        if isinstance(base, memoryview):
+            base = base.obj
+        self.assertEqual(type(base).__name__, "arraybuffer")
+        self.assertEqual(d.dtype, numpy.float64)
+        numpy.testing.assert_array_equal(d, numpy.arange(4.))
+        self.assertEqual(c.shape, (4, 3, 2))
+        self.assertEqual(c.dtype, numpy.complex128)
+        d[0] = 10                     # the result is writable
+        self.assertEqual(t.getcol("cold")[0], 0)
+        self.assertEqual(list(t.getcol("cols")), ['', '', '', ''])
+        t.close()
+        tabledelete("ttable.py_tmp.tab1")
+
+    def test_row_get(self):
+        """Rows are converted using a cached plan, optionally lazily."""
+        c1 = makescacoldesc("coli", 0)
+        c2 = makescacoldesc("cols", "")
+        c3 = makescacoldesc("colc", 0. + 0j)
+        c4 = makearrcoldesc("colarr", 0., shape=[2])
+        t = table("ttable.py_tmp.tab1", maketabdesc((c1, c2, c3, c4)),
+                  ack=False)
+        t.addrows(3)
+        t.putcol("coli", numpy.arange(3))
+        t.putcol("cols", ['a', 'b', 'c'])
+        t.putcol("colarr", numpy.arange(6.).reshape(3, 2))
+        tr = t.row()
+        rows = [tr.get(i) for i in range(3)]
+        self.assertEqual(rows[2]['coli'], 2)
+        self.assertEqual(rows[1]['cols'], 'b')
+        self.assertEqual(rows[0]['colc'], 0j)
+        numpy.testing.assert_array_equal(rows[2]['colarr'], [4., 5.])
+        self.assertEqual(sorted(rows[0].keys()), sorted(t.colnames()))
+        lr = tr.get(1, lazy=True)
+        self.assertIsInstance(lr, lazyrow)
+        self.assertEqual(len(lr), 4)
+        self.assertIn('cols', lr)
+        self.assertNotIn('nocol', lr)
+        self.assertEqual(lr['coli'], 1)
+        numpy.testing.assert_array_equal(lr['colarr'], [2., 3.])
+        self.assertRaises(KeyError, lambda: lr['nocol'])
+        self.assertEqual(lr.todict()['cols'], rows[1]['cols'])
+        r = tr.get_range(1)
+        self.assertEqual(r.shape, (2,))
+        self.assertEqual(r.dtype['colarr'].shape, (2,))
+        numpy.testing.assert_array_equal(r['coli'], [1, 2])
+        self.assertEqual(list(r['cols']), ['b', 'c'])
+        numpy.testing.assert_array_equal(r['colarr'], [[2., 3.], [4., 5.]])
+        self.assertEqual(len(tr.get_range(0, 2)), 2)
+        e = tr.get_range(3)
+        self.assertEqual(e.shape, (0,))
+        self.assertEqual(e.dtype.names, r.dtype.names)
+        self.assertEqual(e.dtype['colarr'].shape, (2,))
+        self.assertRaises(RuntimeError, tr.get_range, 4)
+        # The string width is in characters, not bytes.
+        t.putcell('cols', 2, u'\u00e9\u00e9')
+        self.assertEqual(tr.get_range(2)['cols'][0], u'\u00e9\u00e9')
+        self.assertEqual(tr.get_range(2).dtype['cols'].itemsize, 2 * 4)
+        t.putcell('cols', 1, u'x\u20ac\U0001d11e')
+        self.assertEqual(list(tr.get_range(1)['cols']),
+                         [u'x\u20ac\U0001d11e', u'\u00e9\u00e9'])
+        t.putkeyword('key', {'sub': 1, 'arr': numpy.arange(2)})
+        kw = t.getkeywords()
+        self.assertEqual(kw['key']['sub'], 1)
+        numpy.testing.assert_array_equal(kw['key']['arr'], [0, 1])
+        t.close()
+        tabledelete("ttable.py_tmp.tab1")
+
+    def test_getcol_packed(self):
+        """Boolean columns packed into bits."""
+        c1 = makearrcoldesc("FLAG", True, shape=[3, 11])
+        c2 = makescacoldesc("colb", True)
+        c3 = makescacoldesc("cold", 0.)
+        t = table("ttable.py_tmp.tab1", maketabdesc((c1, c2, c3)), ack=False)
+        t.addrows(5)
+        flags = (numpy.arange(5 * 3 * 11) % 3 == 0).reshape(5, 3, 11)
+        t.putcol("FLAG", flags)
+        t.putcol("colb", flags[:, 0, 0])
+        p = t.getcol("FLAG", packed=True)
+        self.assertEqual(p.dtype, numpy.uint8)
+        self.assertEqual(p.shape, (5, 3, 2))
+        numpy.testing.assert_array_equal(p, numpy.packbits(flags, axis=-1))
+        numpy.testing.assert_array_equal(
+            t.col("FLAG").getcol(1, 3, 2, packed=True),
+            numpy.packbits(flags[1::2], axis=-1))
+        numpy.testing.assert_array_equal(t.getcol("colb", packed=True),
+                                         numpy.packbits(flags[:, 0, 0]))
+        e = t.getcol("FLAG", 5, packed=True)
+        self.assertEqual(e.shape, (0, 3, 2))
+        self.assertEqual(e.shape,
+                         numpy.packbits(flags[5:], axis=-1).shape)
+        self.assertRaises(RuntimeError, t.getcol, "cold", packed=True)
+        t.close()
+        tabledelete("ttable.py_tmp.tab1")
+
+    def test_varcol_ragged(self):
+        """Variable shaped columns as ragged arrays."""
+        c1 = makearrcoldesc("colarr", 0.)
+        t = table("ttable.py_tmp.tab1", maketabdesc(c1), ack=False)
+        t.addrows(3)
+        t.putcell("colarr", 0, numpy.arange(6.).reshape(2, 3))
+        t.putcell("colarr", 2, numpy.arange(2.))
+        r = t.getvarcol("colarr", ragged=True)
+        numpy.testing.assert_array_equal(r['offsets'], [0, 6, 6, 8])
+        numpy.testing.assert_array_equal(r['shapes'],
+                                         [[2, 3], [-1, -1], [-1, 2]])
+        numpy.testing.assert_array_equal(r['values'][:6], numpy.arange(6.))
+        r['values'] *= 2
+        t.putvarcol("colarr", r)
+        numpy.testing.assert_array_equal(t.getcell("colarr", 0),
+                                         2 * numpy.arange(6.).reshape(2, 3))
+        numpy.testing.assert_array_equal(t.getcell("colarr", 2), [0., 2.])
+        self.assertFalse(t.iscelldefined("colarr", 1))
+        r = t.col("colarr").getvarcol(1, ragged=True)
+        numpy.testing.assert_array_equal(r['offsets'], [0, 0, 2])
+        t.close()
+        tabledelete("ttable.py_tmp.tab1")
+
     def test_addcolumns(self):
         """Add columns."""
         c1 = makescacoldesc("coli", 0)
@@ -171,6 +311,46 @@ class TestTable(unittest.TestCase):
         t.close()
         tabledelete("ttable.py_tmp.tab1")
 
+    def test_copy_pipelined(self):
+        """Copy a table while reading and writing concurrently."""
+        c1 = makescacoldesc("coli", 0)
+        c2 = makescacoldesc("cols", "")
+        c3 = makearrcoldesc("colarr", 0.)
+        c4 = makearrcoldesc("colfix", 0j, shape=[2, 3])
+        t = table("ttable.py_tmp.tab1", maketabdesc((c1, c2, c3, c4)),
+                  ack=False)
+        t.addrows(10)
+        t.putcol("coli", numpy.arange(10))
+        t.putcol("cols", [str(i) for i in range(10)])
+        t.putcell("colarr", 2, numpy.arange(4.))
+        t.putcell("colarr", 5, numpy.arange(3.))
+        t.putcol("colfix", numpy.ones((10, 2, 3)) * 1j)
+        t.putkeyword("key", 1)
+        t.flush()
+        t1 = t.query("coli > 1")
+        tc = t1.copy("ttable.py_tmp.tab2", readahead=2)
+        self.assertEqual(tc.nrows(), 8)
+        self.assertEqual(tc.getkeyword("key"), 1)
+        numpy.testing.assert_array_equal(tc.getcol("coli"), numpy.arange(2, 10))
+        self.assertEqual(tc.getcol("cols")[0], '2')
+        numpy.testing.assert_array_equal(tc.getcell("colarr", 0),
+                                         numpy.arange(4.))
+        numpy.testing.assert_array_equal(tc.getcell("colarr", 3),
+                                         numpy.arange(3.))
+        self.assertFalse(tc.iscelldefined("colarr", 1))
+        numpy.testing.assert_array_equal(tc.getcol("colfix"),
+                                         t1.getcol("colfix"))
+        tc.close()
+        t1.close()
+        tc = tablecopy("ttable.py_tmp.tab1", "ttable.py_tmp.tab2",
+                       memorytable=True, readahead=1)
+        self.assertEqual(tc.nrows(), 10)
+        numpy.testing.assert_array_equal(tc.getcol("coli"), numpy.arange(10))
+        tc.close()
+        tabledelete("ttable.py_tmp.tab2")
+        t.close()
+        tabledelete("ttable.py_tmp.tab1")
+
     def test_subset(self):
         """Create a subset."""
         c1 = makescacoldesc("coli", 0)
@@ -508,6 +688,34 @@ class TestTable(unittest.TestCase):
         tab.done()
         tabledelete("mytable")
 
+    def test_compresscolumns(self):
+        """Compressed float and complex array columns."""
+        acd1 = makearrcoldesc("DATA", 0j, shape=[4, 2], valuetype='complex')
+        acd2 = makearrcoldesc("WEIGHT", 0., shape=[4, 2], valuetype='float')
+        acd3 = makearrcoldesc("arr", 0., shape=[2])
+        td = maketabdesc([acd1, acd2, acd3])
+        self.assertRaises(ValueError, compresscolumns, td, "arr")
+        compresscolumns(td, ["DATA", "WEIGHT"])
+        self.assertIn("DATA_COMPRESSED", td)
+        self.assertEqual(td["WEIGHT_COMPRESSED"]["valueType"], 'short')
+        dminfo = makedminfo(td)
+        tab = table("ttable.py_tmp.tab1", td, dminfo=dminfo, nrow=3,
+                    ack=False)
+        data = (numpy.arange(24.) - 3j).reshape(3, 4, 2)
+        weight = numpy.arange(24., dtype=numpy.float32).reshape(3, 4, 2)
+        tab.putcol("DATA", data)
+        tab.putcol("WEIGHT", weight)
+        self.assertEqual(tab.getdminfo("DATA")["TYPE"], "CompressComplex")
+        self.assertEqual(tab.getdminfo("WEIGHT")["TYPE"], "CompressFloat")
+        numpy.testing.assert_allclose(tab.getcol("DATA"), data, atol=1e-3)
+        numpy.testing.assert_allclose(tab.getcol("WEIGHT"), weight,
+                                      atol=1e-3)
+        numpy.testing.assert_allclose(tab.getcolslice("WEIGHT", [1, 0],
+                                                      [2, 1]),
+                                      weight[:, 1:3, :], atol=1e-3)
+        tab.close()
+        tabledelete("ttable.py_tmp.tab1")
+
     def test_required_desc(self):
         """Testing required_desc."""
         # =============================================